@@ -51,41 +51,14 @@
 
 #include "GameOfLife.h"
 
-GameOfLife::GameOfLife ( int w, int h ) : m_w ( w ), m_h ( h )
+GameOfLife::GameOfLife ( int w, int h ) : m_w ( w ), m_h ( h ), predictions ( w, h )
 {
 
-  lattices = new char**[2];
-
-  lattices[0] = new char*[m_h];
-  for ( int i {0}; i<m_h; ++i )
-    {
-      lattices[0][i] = new char [m_w];
-    }
-
-  lattices[1] = new char*[m_h];
-
-  for ( int i {0}; i<m_h; ++i )
-    {
-      lattices[1][i] = new char [m_w];
-    }
-
-  predictions = new char*[m_h];
-
-  for ( int i {0}; i<m_h; ++i )
-    {
-      predictions[i] = new char [m_w];
-    }
+  lattices[0] = new Lattice ( m_w, m_h );
+  lattices[1] = new Lattice ( m_w, m_h );
 
   latticeIndex = 0;
 
-  char ** lattice = lattices[latticeIndex];
-
-  for ( int i {0}; i<m_h; ++i )
-    for ( int j {0}; j<m_w; ++j )
-      {
-        lattice[i][j] = 0;
-      }
-
   samuBrain = new SamuBrain ( m_w, m_h );
 
   carx = 0;
@@ -96,31 +69,21 @@ GameOfLife::GameOfLife ( int w, int h ) : m_w ( w ), m_h ( h )
 
 GameOfLife::~GameOfLife()
 {
-  for ( int i {0}; i<m_h; ++i )
-    {
-      delete[] lattices[0][i];
-      delete[] lattices[1][i];
-      delete[] predictions[i];
-    }
-
-  delete[] predictions;
-  delete[] lattices[0];
-  delete[] lattices[1];
-  delete[] lattices;
+  delete lattices[0];
+  delete lattices[1];
 
   delete samuBrain;
 }
 
 
-char ** GameOfLife::lattice()
+LatticeView GameOfLife::lattice()
 {
-  return lattices[latticeIndex];
+  return lattices[latticeIndex]->view();
 }
 
 void GameOfLife::run()
 {
 
-  char **fp, **fr;
   while ( true )
     {
       QThread::msleep ( m_delay );
@@ -128,28 +91,44 @@ void GameOfLife::run()
       if ( !paused )
         {
 
-          ++m_time;
+          tick();
 
-          qDebug() << "<<<" << m_time << "<<<";
+          emit cellsChanged ( lattices[latticeIndex]->view(), predictions.view(), fp, fr );
 
-          development();
+          qDebug() << ">>>" << m_time << ">>>";
 
-          if ( samuBrain )
-            {
-              samuBrain->learning ( lattices[latticeIndex], predictions, &fp, &fr );
-              qDebug() << m_time
-                       << "   #MPUs:" << samuBrain->nofMPUs()
-                       << "Observation (MPU):" << samuBrain->get_foobar().c_str();
-            }
+        }
+    }
 
-          latticeIndex = ( latticeIndex+1 ) %2;
-          emit cellsChanged ( lattices[latticeIndex], predictions, fp, fr );
+}
 
-          qDebug() << ">>>" << m_time << ">>>";
+void GameOfLife::tick()
+{
+  ++m_time;
 
-        }
+  TRACE_SCOPE ( "tick", ChromeTrace::arg ( "t", m_time ) );
+
+  qDebug() << "<<<" << m_time << "<<<";
+
+  development();
+
+  if ( samuBrain )
+    {
+      samuBrain->learning ( lattices[latticeIndex]->view(), predictions.view(), fp, fr );
+      qDebug() << m_time
+               << "   #MPUs:" << samuBrain->nofMPUs()
+               << "Observation (MPU):" << samuBrain->get_foobar().c_str();
     }
 
+  PHASE_TICK();
+
+  latticeIndex = ( latticeIndex+1 ) %2;
+}
+
+void GameOfLife::setAge ( long age )
+{
+  this->age = age;
+  xx = 34;
 }
 
 void GameOfLife::pause()
@@ -157,7 +136,7 @@ void GameOfLife::pause()
   paused = !paused;
 }
 
-int GameOfLife::numberOfNeighbors ( char **lattice, int r, int c, int state )
+int GameOfLife::numberOfNeighbors ( LatticeView lattice, int r, int c, int state )
 {
   int number {0};
 
@@ -196,7 +175,7 @@ int GameOfLife::numberOfNeighbors ( char **lattice, int r, int c, int state )
 }
 
 
-void GameOfLife::clear_lattice ( char **nextLattice )
+void GameOfLife::clear_lattice ( LatticeView nextLattice )
 {
   for ( int i {0}; i<m_h; ++i )
     for ( int j {0}; j<m_w; ++j )
@@ -205,7 +184,7 @@ void GameOfLife::clear_lattice ( char **nextLattice )
       }
 }
 
-void GameOfLife::fill_lattice ( char **nextLattice, int color )
+void GameOfLife::fill_lattice ( LatticeView nextLattice, int color )
 {
   for ( int i {0}; i<m_h; ++i )
     for ( int j {0}; j<m_w; ++j )
@@ -214,7 +193,7 @@ void GameOfLife::fill_lattice ( char **nextLattice, int color )
       }
 }
 
-void GameOfLife::control_Conway ( char **prevLattice, char **nextLattice )
+void GameOfLife::control_Conway ( LatticeView prevLattice, LatticeView nextLattice )
 {
   for ( int i {0}; i<m_h; ++i )
 
@@ -248,7 +227,7 @@ void GameOfLife::control_Conway ( char **prevLattice, char **nextLattice )
       }
 }
 
-void GameOfLife::control_Movie ( char **nextLattice )
+void GameOfLife::control_Movie ( LatticeView nextLattice )
 {
   if ( m_time %3 ==0 )
     {
@@ -281,7 +260,7 @@ void GameOfLife::control_Movie ( char **nextLattice )
 
 }
 
-void GameOfLife::control_Stroop ( char **nextLattice )
+void GameOfLife::control_Stroop ( LatticeView nextLattice )
 {
   if ( ++age <20 )
     {
@@ -327,7 +306,7 @@ void GameOfLife::control_Stroop ( char **nextLattice )
 
 }
 
-void GameOfLife::ticker ( char **lattice, std::string & hello )
+void GameOfLife::ticker ( LatticeView lattice, std::string & hello )
 {
   //static int xx = 34;//hello.length();
 
@@ -355,9 +334,10 @@ void GameOfLife::ticker ( char **lattice, std::string & hello )
 
 void GameOfLife::development()
 {
+  PHASE_TIMER ( DEVELOPMENT );
 
-  char **prevLattice = lattices[latticeIndex];
-  char **nextLattice = lattices[ ( latticeIndex+1 ) %2];
+  LatticeView prevLattice = lattices[latticeIndex]->view();
+  LatticeView nextLattice = lattices[ ( latticeIndex+1 ) %2]->view();
 
   /*
   std::string hello1 = "I am Samu. I am a disembodied developmental robotic agent.";
@@ -1668,7 +1648,7 @@ void GameOfLife::development()
 
 }
 
-void GameOfLife::red ( char **lattice, int x, int y, int color )
+void GameOfLife::red ( LatticeView lattice, int x, int y, int color )
 {
 
   int r[7][17] =
@@ -1695,7 +1675,7 @@ void GameOfLife::red ( char **lattice, int x, int y, int color )
     }
 }
 
-void GameOfLife::green ( char **lattice, int x, int y, int color )
+void GameOfLife::green ( LatticeView lattice, int x, int y, int color )
 {
 
   int r[7][29] =
@@ -1723,7 +1703,7 @@ void GameOfLife::green ( char **lattice, int x, int y, int color )
     }
 }
 
-void GameOfLife::blue ( char **lattice, int x, int y, int color )
+void GameOfLife::blue ( LatticeView lattice, int x, int y, int color )
 {
 
   int r[7][21] =
@@ -1751,7 +1731,7 @@ void GameOfLife::blue ( char **lattice, int x, int y, int color )
     }
 }
 
-void GameOfLife::glider ( char **lattice, int x, int y )
+void GameOfLife::glider ( LatticeView lattice, int x, int y )
 {
 
   lattice[y+0][x+2] = 1;
@@ -1762,7 +1742,7 @@ void GameOfLife::glider ( char **lattice, int x, int y )
 
 }
 
-void GameOfLife::house ( char **lattice, int x, int y )
+void GameOfLife::house ( LatticeView lattice, int x, int y )
 {
 
   lattice[y+0][x+3] = 1;
@@ -1797,7 +1777,7 @@ void GameOfLife::house ( char **lattice, int x, int y )
   lattice[y+8][x+6] = 1;
 }
 
-void GameOfLife::man ( char **lattice, int x, int y )
+void GameOfLife::man ( LatticeView lattice, int x, int y )
 {
 
   lattice[y+0][x+1] = 1;
@@ -1813,7 +1793,7 @@ void GameOfLife::man ( char **lattice, int x, int y )
 
 }
 
-void GameOfLife::car ( char **lattice, int x, int y )
+void GameOfLife::car ( LatticeView lattice, int x, int y )
 {
 
   lattice[y+0][x+1] = 1;
@@ -57,6 +57,10 @@
 #include <sstream>
 #include "SamuBrain.h"
 #include <QApplication>
+#include <QMetaType>
+
+// the views are passed to the GUI thread by queued connections
+Q_DECLARE_METATYPE ( LatticeView )
 
 class GameOfLife : public QThread
 {
@@ -64,11 +68,12 @@ class GameOfLife : public QThread
 
     int m_w {40}, m_h {30};
 
-    char ***lattices;
+    Lattice *lattices[2];
     int latticeIndex;
-    char **predictions;
+    Lattice predictions;
 
     SamuBrain* samuBrain;
+    LatticeView fp, fr;
 
     long m_time {0};
     int m_delay {1};//{15};
@@ -77,29 +82,29 @@ class GameOfLife : public QThread
     bool paused {false};
 
     void development();
-    int  numberOfNeighbors ( char **lattice, int r, int c, int s );
+    int  numberOfNeighbors ( LatticeView lattice, int r, int c, int s );
 
-    void glider ( char **lattice, int x, int y );
-    void car ( char **lattice, int x, int y );
-    void man ( char **lattice, int x, int y );
-    void house ( char **lattice, int x, int y );
+    void glider ( LatticeView lattice, int x, int y );
+    void car ( LatticeView lattice, int x, int y );
+    void man ( LatticeView lattice, int x, int y );
+    void house ( LatticeView lattice, int x, int y );
 
     int carx {0};
     int manx {0};
     int housex {0};
 
-    void red ( char **lattice, int x, int y, int color );
-    void green ( char **lattice, int x, int y, int color );
-    void blue ( char **lattice, int x, int y, int color );
+    void red ( LatticeView lattice, int x, int y, int color );
+    void green ( LatticeView lattice, int x, int y, int color );
+    void blue ( LatticeView lattice, int x, int y, int color );
 
-    void clear_lattice ( char **nextLattice );
-    void fill_lattice ( char **nextLattice, int color );
+    void clear_lattice ( LatticeView nextLattice );
+    void fill_lattice ( LatticeView nextLattice, int color );
 
-    void control_Stroop ( char **nextLattice );
-    void control_Conway ( char **, char **nextLattice );
-    void control_Movie ( char **nextLattice );
+    void control_Stroop ( LatticeView nextLattice );
+    void control_Conway ( LatticeView, LatticeView nextLattice );
+    void control_Movie ( LatticeView nextLattice );
 
-void ticker(char **lattice, std::string &);
+void ticker(LatticeView lattice, std::string &);
     
     
   std::vector<std::string> hello =  
@@ -1316,11 +1321,26 @@ public:
     ~GameOfLife();
 
     void run();
-    char **lattice();
+    void tick();
+    LatticeView lattice();
     int getW() const;
     int getH() const;
     long getT() const;
     void pause();
+    SamuBrain* getSamuBrain() {
+        return samuBrain;
+    }
+    // age is the index of the word of the Sitton list that is shown by the ticker
+    long getAge() const {
+        return age;
+    }
+    void setAge ( long age );
+    int nofWords() const {
+        return hello.size();
+    }
+    std::string word ( int i ) const {
+        return hello[i];
+    }
     int getDelay() const {
         return m_delay;
     }
@@ -1331,7 +1351,7 @@ public:
     }
 
 signals:
-    void cellsChanged ( char **, char **, char **, char ** );
+    void cellsChanged ( LatticeView, LatticeView, LatticeView, LatticeView );
 
 };
 
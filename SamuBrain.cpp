@@ -50,12 +50,50 @@
 
 
 #include "SamuBrain.h"
+#ifdef MEM_PROFILE
+#include <unistd.h>
+#endif
 
 SamuBrain::SamuBrain ( int w, int h ) : m_w ( w ), m_h ( h )
 {
   m_morgan = newMPU();
 
   m_searching = false;
+
+  if ( const char * strategy = std::getenv ( "SAMU_SEARCH" ) )
+    {
+      if ( std::string ( strategy ) == "racing" )
+        {
+          m_searchStrategy = RACING;
+        }
+    }
+
+  if ( std::getenv ( "SAMU_WARM_START" ) )
+    {
+      m_warmStart = true;
+    }
+
+  if ( std::getenv ( "SAMU_SPECULATIVE" ) )
+    {
+      m_speculative = true;
+    }
+
+  if ( std::getenv ( "SAMU_REPLAY" ) )
+    {
+      setReplay ( true );
+    }
+
+  if ( const char * cutoff = std::getenv ( "SAMU_SEARCH_RANK" ) )
+    {
+      setSearchRanking ( true, std::atoi ( cutoff ) );
+    }
+
+#ifdef MEM_PROFILE
+  if ( const char * period = std::getenv ( "SAMU_MEM_PERIOD" ) )
+    {
+      m_memPeriod = std::max ( 1, std::atoi ( period ) );
+    }
+#endif
 }
 
 SamuBrain::~SamuBrain()
@@ -66,9 +104,13 @@ SamuBrain::~SamuBrain()
       delete mpu.second;
     }
 
+  delete m_provisional;
+
 }
 
-MentalProcessingUnit::MentalProcessingUnit ( int w, int h ) : m_w ( w ), m_h ( h )
+MentalProcessingUnit::MentalProcessingUnit ( HabituationBank & habituations, int w, int h ) :
+  m_w ( w ), m_h ( h ), m_habi ( habituations, this ), m_planes ( w, 3*h ),
+  m_prev ( m_planes.rows ( 0, h ) ), fr ( m_planes.rows ( 2*h, h ) ), fp ( m_planes.rows ( h, h ) )
 {
 
   m_samuQl = new QL*[m_h];
@@ -78,32 +120,44 @@ MentalProcessingUnit::MentalProcessingUnit ( int w, int h ) : m_w ( w ), m_h ( h
       m_samuQl[i] = new QL [m_w];
     }
 
-  m_prev = new char*[m_h];
-  fp = new char*[m_h];
-  fr = new char*[m_h];
+}
 
-  for ( int i {0}; i<m_h; ++i )
+void MentalProcessingUnit::cls ( )
+{
+  m_planes.clear();
+}
+
+void MentalProcessingUnit::compare ( int r, const char *reality )
+{
+  const char *prev = m_prev[r];
+  // fp is an intensity between 0 and 255, it must not wrap at 127 as a signed char
+  unsigned char *fpr = reinterpret_cast<unsigned char *> ( fp[r] );
+
+  // byte lanes with byte counters, so the counters are flushed after every 255 cells
+  for ( int b {0}; b<m_w; b+=255 )
     {
-      m_prev[i] = new char [m_w];
-      fp[i] = new char [m_w];
-      fr[i] = new char [m_w];
-    }
+      int e = std::min ( b+255, m_w );
+      unsigned char s {0};
+      unsigned char vs {0};
 
-  for ( int r {0}; r<m_h; ++r )
-    for ( int c {0}; c<m_w; ++c )
-      {
-        fr[r][c] =fp[r][c] = m_prev[r][c] = 0;
-      }
+      #pragma omp simd reduction(+:s,vs)
+      for ( int c = b; c<e; ++c )
+        {
+          unsigned char same = reality[c] == prev[c];
+          unsigned char seen = reality[c] != 0;
 
-}
+          vs += seen;
+          s += seen & same;
 
-void MentalProcessingUnit::cls ( )
-{
-  for ( int r {0}; r<m_h; ++r )
-    for ( int c {0}; c<m_w; ++c )
-      {
-        fr[r][c] =fp[r][c] = m_prev[r][c] = 0;
-      }
+          unsigned char f = fpr[c];
+          unsigned char up = f < 255-60 ? 60 : 0;
+          unsigned char down = f > 60 ? 60 : 0;
+          fpr[c] = same ? f + up : f - down;
+        }
+
+      sum += s;
+      vsum += vs;
+    }
 }
 
 MentalProcessingUnit::~MentalProcessingUnit ( )
@@ -116,19 +170,16 @@ MentalProcessingUnit::~MentalProcessingUnit ( )
 
   delete[] m_samuQl;
 
-  for ( int i {0}; i<m_h; ++i )
-    {
-      delete [] m_prev[i];
-    }
-  delete [] m_prev;
-
 }
 
 
-MORGAN SamuBrain::newMPU ()
+MORGAN SamuBrain::newMPU ( MORGAN morgan )
 {
 
-  MORGAN morgan = new MentalProcessingUnit ( m_w, m_h );
+  if ( !morgan )
+    {
+      morgan = new MentalProcessingUnit ( m_habituations, m_w, m_h );
+    }
 
   std::stringstream ss;
   ss << "Foobar";
@@ -192,7 +243,7 @@ double SamuBrain::howMuchLearned ( MPU samuQl ) const
 }
 */
 
-int SamuBrain::pred ( char **reality, char **predictions, int isLearning, int & vsum )
+int SamuBrain::pred ( LatticeView reality, LatticeView predictions, int isLearning, int & vsum )
 {
   return pred ( m_morgan, reality, predictions, isLearning, vsum );
 }
@@ -300,20 +351,8 @@ int SamuBrain::pred ( MORGAN morgan, char **reality, char **predictions, int isL
 */
 
 
-void SamuBrain::apred ( /*MORGAN morgan*/ int r, int c, char **reality, char **predictions, int isLearning )
+unsigned long long SamuBrain::context_key ( int r, int c, LatticeView reality ) const
 {
-
-
-
-  /*
-  for ( int r {0}; r<m_h; ++r )
-    {
-      for ( int c {0}; c<m_w; ++c )
-        {
-  */
-
-
-
   unsigned long long prg {1};
 
   prg *= prime[0];
@@ -367,236 +406,119 @@ void SamuBrain::apred ( /*MORGAN morgan*/ int r, int c, char **reality, char **p
       prg *= prime[25+  reality[r][c+1]]; //img_input[1];
     }
 
-  /*
-  qDebug() << "   PPP:"
-         << m_internal_clock
-         << prg << "%";
-  */
+  return prg;
+}
 
-  #pragma omp parallel
+void SamuBrain::apred ( LatticeView reality, LatticeView predictions, int isLearning )
+{
+  PHASE_TIMER ( APRED );
+
+  // the keys are the same for all the MPUs
+  std::vector<unsigned long long> prg ( m_h*m_w );
+
+  for ( int r {0}; r<m_h; ++r )
+    {
+      for ( int c {0}; c<m_w; ++c )
+        {
+          prg[r*m_w+c] = context_key ( r, c, reality );
+        }
+    }
+
+  #pragma omp parallel num_threads ( SamuThreads::budget() )
   {
     #pragma omp single
     {
 
-      for ( auto mpu : m_brain )
+      for ( auto& candidate : m_candidates )
         {
 
           #pragma omp task
           {
 
-            MORGAN morgan = mpu.second;
-            MPU samuQl = morgan->getSamu();
-            char ** prev = morgan->getPrev();
-            char ** fp = morgan->getFp();
-            char ** fr = morgan->getFr();
+            TRACE_SCOPE ( "MPU", ChromeTrace::arg ( "mpu", candidate.name ) );
 
-            SPOTriplet response = samuQl[r][c] ( reality[r][c], prg, isLearning == 0 );
+            MORGAN morgan = candidate.mpu;
+            MPU samuQl = morgan->getSamu();
+            LatticeView prev = morgan->getPrev();
+            LatticeView fr = morgan->getFr();
 
-            if ( reality[r][c] )
+            for ( int r {0}; r<m_h; ++r )
               {
-                ++morgan->vsum;
-                if ( reality[r][c] == prev[r][c] )
+                morgan->compare ( r, reality[r] );
+
+                for ( int c {0}; c<m_w; ++c )
                   {
-                    ++morgan->sum;
-                  }
-              }
+                    SPOTriplet response = samuQl[r][c] ( reality[r][c], prg[r*m_w+c], isLearning == 0 );
 
+                    fr[r][c] = samuQl[r][c].getNumRules();
 
-            if ( reality[r][c] == prev[r][c] )
-              {
-                if ( fp[r][c] < 255-60 )
-                  {
-                    fp[r][c]+=60;
-                  }
-              }
-            else
-              {
-                if ( fp[r][c] > 60 )
-                  {
-                    fp[r][c]-=60;
+                    prev[r][c] = response;
                   }
               }
 
+          }
+        }// for
 
-            fr[r][c] = samuQl[r][c].getNumRules();
-
-            prev[r][c] = predictions[r][c] = response;
-
-            if ( isLearning>0 && predictions[r][c] == 0 )
-              {
-                predictions[r][c] = isLearning;
-              }
+      if ( m_provisional )
+        {
 
+          #pragma omp task
+          {
+            int vsum;
+            pred ( m_provisional, reality, m_provisionalPredictions.view(), 0, vsum, false );
           }
-        }// for
+
+        }
 
     }
 
   }
-  /*        }
 
-      }
-  */
-  //return sum;
+  // the predictions of the last candidate are shown
+  if ( !m_candidates.empty() )
+    {
+      LatticeView prev = m_candidates.back().mpu->getPrev();
+
+      for ( int r {0}; r<m_h; ++r )
+        {
+          for ( int c {0}; c<m_w; ++c )
+            {
+              predictions[r][c] = prev[r][c];
+
+              if ( isLearning>0 && predictions[r][c] == 0 )
+                {
+                  predictions[r][c] = isLearning;
+                }
+            }
+        }
+    }
 }
 
 
-int SamuBrain::pred ( MORGAN morgan, char **reality, char **predictions, int isLearning, int & vsum )
+int SamuBrain::pred ( MORGAN morgan, LatticeView reality, LatticeView predictions, int isLearning, int & vsum, bool verbose )
 {
+  PHASE_TIMER ( PRED );
 
   MPU samuQl = morgan->getSamu();
-  char ** prev = morgan->getPrev();
-  char ** fp = morgan->getFp();
-  char ** fr = morgan->getFr();
+  LatticeView prev = morgan->getPrev();
+  LatticeView fr = morgan->getFr();
 
   //double img_input[40];
   //int colors[256];
-  int sum {0};
-
-  vsum = 0;
+  morgan->sum = 0;
+  morgan->vsum = 0;
 
   for ( int r {0}; r<m_h; ++r )
     {
+      morgan->compare ( r, reality[r] );
+
       for ( int c {0}; c<m_w; ++c )
         {
 
           //std::stringstream ss;
           //int ii {0};
 
-          unsigned long long prg {1};
-
-          /*
-                for ( int ci {0}; ci<5; ++ci )
-                  {
-                    colors[ci] = 0;
-                  }
-          */
-          /*
-
-                for ( int i {-1}; i<2; ++i )
-                  for ( int j {-1}; j<2; ++j )
-
-                    if ( ! ( ( i==0 ) && ( j==0 ) ) )
-
-                      {
-                        int o = c + j;
-                        if ( o < 0 )
-                          {
-                            o = m_w-1;
-                          }
-                        else if ( o >= m_w )
-                          {
-                            o = 0;
-                          }
-
-                        int s = r + i;
-                        if ( s < 0 )
-                          {
-                            s = m_h-1;
-                          }
-                        else if ( s >= m_h )
-                          {
-                            s = 0;
-                          }
-
-                        ++colors[reality[s][o]];
-
-
-                      } // if
-
-                  */
-
-
-          //ss << reality[r][c];
-          //ss << '|';
-
-          prg *= prime[0];
-          prg *= prime[13+reality[r][c]];
-
-          if ( c>2 )
-            {
-              /*
-                  ss << reality[r][c-1]; //img_input[1];
-                  ss << '|';
-                  ss << reality[r][c-2]; //img_input[1];
-                  ss << '|';
-                  ss << reality[r][c-3]; //img_input[1];
-                  ss << '|';
-                  */
-
-              prg *= prime[1];
-              prg *= prime[14+ reality[r][c-1]]; //img_input[1];
-              prg *= prime[2];
-              prg *= prime[15+  reality[r][c-2]]; //img_input[1];
-              prg *= prime[3];
-              prg *= prime[16+  reality[r][c-3]]; //img_input[1];
-
-            }
-          else if ( c>1 )
-            {
-              /*
-                  ss << reality[r][c-1]; //img_input[1];
-                  ss << '|';
-                  ss << reality[r][c-2]; //img_input[1];
-                  ss << '|';
-                  */
-              prg *= prime[4];
-              prg *= prime[17+  reality[r][c-1]]; //img_input[1];
-              prg *= prime[5];
-              prg *= prime[18+  reality[r][c-2]]; //img_input[1];
-
-            }
-          else if ( c >0 )
-            {
-              /*
-                  ss << reality[r][c-1]; //img_input[1];
-                  ss << '|';
-                  */
-              prg *= prime[6];
-              prg *= prime[19+  reality[r][c-1]]; //img_input[1];
-            }
-
-          if ( c<m_w-3 )
-            {
-              /*
-                  ss << reality[r][c+1]; //img_input[1];
-                  ss << '|';
-                  ss << reality[r][c+2]; //img_input[1];
-                  ss << '|';
-                  ss << reality[r][c+3]; //img_input[1];
-                  ss << '|';
-                  */
-              prg *= prime[7];
-              prg *= prime[20+  reality[r][c+1]]; //img_input[1];
-              prg *= prime[8];
-              prg *= prime[21+  reality[r][c+2]]; //img_input[1];
-              prg *= prime[9];
-              prg *= prime[22+  reality[r][c+3]]; //img_input[1];
-
-
-            }
-          else if ( c<m_w-2 )
-            {
-              /*
-                  ss << reality[r][c+1]; //img_input[1];
-                  ss << '|';
-                  ss << reality[r][c+2]; //img_input[1];
-                  ss << '|';
-                  */
-              prg *= prime[10];
-              prg *= prime[23+  reality[r][c+1]]; //img_input[1];
-              prg *= prime[11];
-              prg *= prime[24+  reality[r][c+2]]; //img_input[1];
-            }
-          else if ( c <m_w-1 )
-            {
-              /*
-              	      ss << reality[r][c+1]; //img_input[1];
-                            ss << '|';
-                            */
-              prg *= prime[12];
-              prg *= prime[25+  reality[r][c+1]]; //img_input[1];
-            }
+          unsigned long long prg = context_key ( r, c, reality );
 
 
           /*
@@ -624,48 +546,18 @@ int SamuBrain::pred ( MORGAN morgan, char **reality, char **predictions, int isL
           //predictions[r][c] =  prev[r][c];
 
 
-          qDebug() << "   PPP:"
-                   << m_internal_clock
-                   << prg << "%";
-
-
-          SPOTriplet response = samuQl[r][c] ( reality[r][c], prg, isLearning == 0 );
-
-          if ( reality[r][c] )
-            //if ( ( predictions[r][c] == reality[r][c] ) && ( reality[r][c] != 0 ) )
+          if ( verbose )
             {
-              ++vsum;
-              //if (  samuQl[r][c].reward() == samuQl[r][c].get_max_reward()/*reality[r][c] == prev[r][c]*/ )
-              if ( reality[r][c] == prev[r][c] )
-                {
-                  ++sum;
-//		  if(!isLearning)
-//		  ++fp[r][c];
-                }
+              qDebug() << "   PPP:"
+                       << m_internal_clock
+                       << prg << "%";
             }
 
-          // if ( !isLearning )
-          {
-
-            if ( reality[r][c] == prev[r][c] )
-              {
-                if ( fp[r][c] < 255-60 )
-                  {
-                    fp[r][c]+=60;
-                  }
-              }
-            else
-              {
-                if ( fp[r][c] > 60 )
-                  {
-                    fp[r][c]-=60;
-                  }
-              }
-
 
-            fr[r][c] = samuQl[r][c].getNumRules();
+          SPOTriplet response = samuQl[r][c] ( reality[r][c], prg, isLearning == 0 );
 
-          }
+          // the matches of the row and fp are done by MentalProcessingUnit::compare
+          fr[r][c] = samuQl[r][c].getNumRules();
 
           //prev[r][c] = reality[r][c];
           prev[r][c] = predictions[r][c] = response;
@@ -694,7 +586,8 @@ int SamuBrain::pred ( MORGAN morgan, char **reality, char **predictions, int isL
 
     }
 
-  return sum;
+  vsum = morgan->vsum;
+  return morgan->sum;
 }
 
 /*
@@ -748,254 +641,424 @@ bool SamuBrain::is_habituation ( int q, int w, int e, int r, int t, int z, int &
 }
 */
 
-bool Habituation::is_newinput ( int vsum, int sum ) //, double &mon )
-{
-  return ( sum < masum ) || ( vsum < mavsum );
-}
-
-bool Habituation::is_habituation ( int vsum, int sum, double &mon )
+int HabituationBank::acquire ( MentalProcessingUnit * owner )
 {
+  int slot;
 
-  int ssum {0};
-  int svsum {0};
+  if ( m_free.empty() )
+    {
+      slot = m_owner.size();
 
-  for ( int ci {0}; ci<ma_limit-1; ++ci )
+      m_mem.push_back ( 0 );
+      m_err.push_back ( 0 );
+      for ( int ci {0}; ci<ma_limit; ++ci )
+        {
+          m_msum[ci].push_back ( 0 );
+          m_asum[ci].push_back ( 0 );
+        }
+      m_masum.push_back ( 0 );
+      m_mavsum.push_back ( 0 );
+      m_vsum.push_back ( 0 );
+      m_sum.push_back ( 0 );
+      m_mon.push_back ( -1 );
+      m_habi.push_back ( false );
+      m_converged.push_back ( false );
+      m_fed.push_back ( false );
+      m_owner.push_back ( owner );
+    }
+  else
     {
-      ssum += ( msum[ci] = msum[ci+1] );
-      svsum += ( asum[ci] = asum[ci+1] );
+      slot = m_free.back();
+      m_free.pop_back();
+      m_owner[slot] = owner;
     }
-  ssum += ( msum[ma_limit-1] = sum );
-  svsum += ( asum[ma_limit-1] = vsum );
 
-  masum = ( int ) ( ( double ) ssum / ( double ) ma_limit );
-  mavsum = ( int ) ( ( double ) svsum / ( double ) ma_limit );
+  reset ( slot );
 
-  int q, w,  e,  r, t, z;
-
-  q= vsum, w =sum;
-  e= mavsum;
-  r= masum;
-  t= masum - msum[ma_limit-1];
-  z = mavsum - asum[ma_limit-1];
+  return slot;
+}
 
+void HabituationBank::release ( int slot )
+{
+  m_owner[slot] = nullptr;
+  m_fed[slot] = false;
+  m_free.push_back ( slot );
+}
 
-  qDebug() << "   HABITUATION MONITOR:"
-           << "(isHABI MPU)"
-           << vsum << sum << mavsum << masum
-           << masum - msum[ma_limit-1]
-           << mavsum - asum[ma_limit-1];
+void HabituationBank::clear ( int slot )
+{
+  m_mem[slot] = 0;
+  m_err[slot] = 0;
 
-  if ( q != 0
-       && q == w
-       /*
-              && e != 0
-              && e == r
-              && t == z*/
-     )
+  for ( int ci {0}; ci<ma_limit; ++ci )
     {
+      m_msum[ci][slot] = m_asum[ci][slot] = 0;
+    }
+}
 
-      mon = ( ( double ) mem/ ( double ) convergence_limit );
-      err = 0;
+void HabituationBank::reset ( int slot )
+{
+  clear ( slot );
 
-      if ( mem >= convergence_limit )
+  m_masum[slot] = m_mavsum[slot] = 0;
+  m_vsum[slot] = m_sum[slot] = 0;
+  m_mon[slot] = -1;
+  m_habi[slot] = m_converged[slot] = false;
+  m_fed[slot] = false;
+}
+
+std::vector<MentalProcessingUnit*> HabituationBank::update ()
+{
+  std::vector<MentalProcessingUnit*> converged;
+
+  // the fed slots are updated by runs, the others (the freed slots, the MPUs
+  // that are not searched in this tick) keep their state
+  for ( int from {0}; from<size(); )
+    {
+      if ( !m_fed[from] )
         {
-          return true;
+          ++from;
+          continue;
         }
-      else
+
+      int to {from};
+      while ( to<size() && m_fed[to] )
         {
-          ++mem;
-          return false;
+          ++to;
         }
-    }
-  else
-    {
-      /*
-            if ( q == 0
-                 && q == w
-      	 )
-      	 */
-      if ( q == 0
-           && q == w
-           && e != 0
-           && e == r
-           && t == z
-         )
-        {
-          ++err;
-          //  if(mem >1) mem-=2;
-          mon = ( ( double ) mem/ ( double ) convergence_limit );
 
-          if ( mem >= convergence_limit )
-            {
-              ;
-            }
-          else
-            {
-              ;//  ++mem;
-            }
-        }
-      else
+      update ( from, to );
+
+      for ( int i {from}; i<to; ++i )
         {
-          if ( err < error_limit )
-            {
-              ++err;
-            }
-          else
+          if ( m_converged[i] )
             {
-              mon = 0.0;
-              err = mem = 0;
+              converged.push_back ( m_owner[i] );
             }
         }
-      return false;
+
+      from = to;
     }
-}
 
+  return converged;
+}
 
-void SamuBrain::learning ( char **reality, char **predictions, char ***fp, char ***fr )
+void HabituationBank::update ( int from, int to )
 {
-  this->fp = fp;
-  this->fr = fr;
-
-  ++m_internal_clock;
-
-
-  if ( m_searching )
+  PHASE_TIMER ( HABITUATION );
+
+  int *mem = m_mem.data();
+  int *err = m_err.data();
+  int *masum = m_masum.data();
+  int *mavsum = m_mavsum.data();
+  const int *vsum = m_vsum.data();
+  const int *sum = m_sum.data();
+  int *mon = m_mon.data();
+  char *habi = m_habi.data();
+  char *converged = m_converged.data();
+
+  // the former Habituation::is_habituation in passes that can be vectorized:
+  // the moving average windows are shifted first, then the branches are done as selects
+  #pragma omp simd
+  for ( int i = from; i<to; ++i )
     {
+      masum[i] = mavsum[i] = 0;
+    }
 
-      * ( this->fp ) = nullptr ;
-      * ( this->fr ) = nullptr ;
+  for ( int ci {0}; ci<ma_limit-1; ++ci )
+    {
+      int *msum = m_msum[ci].data(), *msum1 = m_msum[ci+1].data();
+      int *asum = m_asum[ci].data(), *asum1 = m_asum[ci+1].data();
 
-      MORGAN maxSamuQl {nullptr};
+      #pragma omp simd
+      for ( int i = from; i<to; ++i )
+        {
+          masum[i] += ( msum[i] = msum1[i] );
+          mavsum[i] += ( asum[i] = asum1[i] );
+        }
+    }
 
-      //#pragma omp parallel for
+  int *msum = m_msum[ma_limit-1].data();
+  int *asum = m_asum[ma_limit-1].data();
 
-      /*
-      #pragma omp parallel
-      {
-        #pragma omp single
+  #pragma omp simd
+  for ( int i = from; i<to; ++i )
+    {
+      // the sums are not negative, so it is the same as the former ( int ) ( ( double ) ssum / ( double ) ma_limit )
+      masum[i] = ( masum[i] + ( msum[i] = sum[i] ) ) / ma_limit;
+      mavsum[i] = ( mavsum[i] + ( asum[i] = vsum[i] ) ) / ma_limit;
+
+      int q = vsum[i], w = sum[i];
+      int e = mavsum[i];
+      int r = masum[i];
+      int t = masum[i] - msum[i];
+      int z = mavsum[i] - asum[i];
+
+      int same = ( q != 0 ) & ( q == w );
+      int silent = ( q == 0 ) & ( w == 0 ) & ( e != 0 ) & ( e == r ) & ( t == z );
+      int reset = ( ( same | silent ) ^ 1 ) & ( err[i] >= error_limit );
+      int done = mem[i] >= convergence_limit;
+
+      int m = ( same | silent ) ? mem[i] : -1;
+      m = reset ? 0 : m;
+
+      habi[i] = same & done;
+      converged[i] = ( same & done ) | ( m >= convergence_limit );
+      mon[i] = m;
+
+      mem[i] = reset ? 0 : mem[i] + ( same & ( done ^ 1 ) );
+      err[i] = ( same | reset ) ? 0 : err[i] + 1;
+    }
+
+  for ( int i = from; i<to; ++i )
+    {
+      m_fed[i] = false;
+
+      if ( m_owner[i] )
+        {
+          qDebug() << "   HABITUATION MONITOR:"
+                   << "(isHABI MPU)"
+                   << vsum[i] << sum[i] << mavsum[i] << masum[i]
+                   << masum[i] - msum[i]
+                   << mavsum[i] - asum[i];
+        }
+      else
         {
+          converged[i] = false;
+        }
+    }
+}
 
-          for ( auto mpu : m_brain )
-            {
+bool Habituation::is_habituation ( int vsum, int sum, double &mon )
+{
+  bank.input ( slot, vsum, sum );
+  bank.update ( slot, slot+1 );
 
-              #pragma omp task
-              {
-      */
+  if ( bank.monitor ( slot ) != -1.0 )
+    {
+      mon = bank.monitor ( slot );
+    }
+
+  return bank.is_habituation ( slot );
+}
+
+
+MORGAN SamuBrain::search ( LatticeView reality, LatticeView predictions, int t )
+{
+  MORGAN maxSamuQl {nullptr};
+
+  //#pragma omp parallel for
+
+  /*
+  #pragma omp parallel
+  {
+    #pragma omp single
+    {
 
       for ( auto mpu : m_brain )
         {
 
-          MORGAN morgan = mpu.second;
-          morgan->sum = 0;
-          morgan->vsum = 0;
+          #pragma omp task
+          {
+  */
 
-        }
+  for ( auto& candidate : m_candidates )
+    {
 
+      MORGAN morgan = candidate.mpu;
+      morgan->sum = 0;
+      morgan->vsum = 0;
 
-      for ( int r {0}; r<m_h; ++r )
+    }
+
+
+  apred ( reality, predictions, 4 );
+  /*
+  for ( int r {0}; r<m_h; ++r )
+  {
+    for ( int c {0}; c<m_w; ++c )
+      {
+  */
+  int ell = 0	;
+
+
+  /* 20 - real 2m37 vs. 4m54
+        #pragma omp parallel
+  {
+  #pragma omp single
+  {
+
+    for ( auto mpu : m_brain )
+      {
+
+        #pragma omp task
         {
-          for ( int c {0}; c<m_w; ++c )
-            {
+  */
+  for ( auto& candidate : m_candidates )
+    {
+      MORGAN morgan = candidate.mpu;
+      morgan->getHabituation().input ( morgan->vsum, morgan->sum );
 
-              apred ( r, c, reality, predictions, 4 );
+      candidate.sum += morgan->sum;
+      candidate.vsum += morgan->vsum;
+    }
 
-            }
+  if ( m_provisional )
+    {
+      m_provisional->getHabituation().input ( m_provisional->vsum, m_provisional->sum );
+    }
 
-        }
+  std::vector<MentalProcessingUnit*> converged = m_habituations.update();
+
+  for ( auto& candidate : m_candidates )
+    {
+
+      MORGAN morgan = candidate.mpu;
+
+      //sum = pred ( morgan, reality, predictions, 4, vsum );
+      Habituation &h = morgan->getHabituation();
+      double mon = h.monitor();
       /*
-      for ( int r {0}; r<m_h; ++r )
-      {
-        for ( int c {0}; c<m_w; ++c )
-          {
+                    qDebug() << "   HABITUATION MONITOR:"
+                             << m_internal_clock
+                             << "[SEARCHING] MPU:" << mpu.first.c_str()
+                             << "bogocertainty of convergence:"
+                             << mon*100 << "%";
       */
-      int ell = 0	;
+      if ( h.is_converged() ) //.9 )
+        {
+          ++ell;
+        }
 
+      qDebug() << "   HABITUATION MONITOR:"
+               << m_internal_clock
+               << "[SEARCHING] MPU:" << candidate.name.c_str()
+               << "bogocertainty of convergence:"
+               << mon*100 << "%" << "ELL" << ell;
 
-      /* 20 - real 2m37 vs. 4m54
-            #pragma omp parallel
-      {
-      #pragma omp single
-      {
+    }
 
-        for ( auto mpu : m_brain )
-          {
+  // the last converged one in the order of the candidates
+  for ( auto candidate = m_candidates.rbegin(); candidate != m_candidates.rend() && !converged.empty(); ++candidate )
+    {
+      if ( std::find ( converged.begin(), converged.end(), candidate->mpu ) != converged.end() )
+        {
+          maxSamuQl = candidate->mpu;
+          break;
+        }
+    }
 
-            #pragma omp task
-            {
-      */
-      for ( auto mpu : m_brain )
+  m_searchWork += m_candidates.size();
+  m_exhaustiveWork += m_brain.size();
+  /*
+          }
+  	}
+  	*/
+  /*
+                }//task
+              } // for MPUs
+          }//single
+        }//para
+  */
+
+  // the sensitization fires on the tail of the previous input, so the
+  // keys of the first frames of the search are collected for the ranking
+  if ( t <= rank_window )
+    {
+      collect_keys ( reality, m_searchKeys );
+
+      if ( m_searchRanked && t == rank_window && !maxSamuQl )
         {
+          rank();
+        }
+    }
 
+  if ( m_searchStrategy == RACING && !maxSamuQl && t % race_window == 0 )
+    {
+      race();
+    }
 
+  return maxSamuQl;
+}
 
-          int sum {0};
-          int vsum {0};
+void SamuBrain::learning ( LatticeView reality, LatticeView predictions, LatticeView &fp, LatticeView &fr )
+{
+  PHASE_TIMER ( LEARNING );
+  TRACE_SCOPE ( m_searching ? "searching" : "learning", ChromeTrace::arg ( "MPUs", m_brain.size() ) );
 
+  this->fp = &fp;
+  this->fr = &fr;
 
-          MORGAN morgan = mpu.second;
+  ++m_internal_clock;
 
-          //sum = pred ( morgan, reality, predictions, 4, vsum );
-          sum = morgan->sum;
-          vsum = morgan->vsum;
+#ifdef MEM_PROFILE
+  if ( m_internal_clock % m_memPeriod == 0 )
+    {
+      mem_profile();
+    }
+#endif
 
-          double mon {-1.0};
-          Habituation &h = morgan->getHabituation();
-          bool habi =
-            h.is_habituation ( vsum, sum, mon );
-          /*
-                        qDebug() << "   HABITUATION MONITOR:"
-                                 << m_internal_clock
-                                 << "[SEARCHING] MPU:" << mpu.first.c_str()
-                                 << "bogocertainty of convergence:"
-                                 << mon*100 << "%";
-          */
-          if ( habi || mon >= 1.0 ) //.9 )
-            {
-              maxSamuQl = mpu.second;
-              ++ell;
-            }
 
-          qDebug() << "   HABITUATION MONITOR:"
-                   << m_internal_clock
-                   << "[SEARCHING] MPU:" << mpu.first.c_str()
-                   << "bogocertainty of convergence:"
-                   << mon*100 << "%" << "ELL" << ell;
+  if ( m_searching )
+    {
 
-        }
-      /*
-              }
-      	}
-      	*/
-      /*
-                    }//task
-                  } // for MPUs
-              }//single
-            }//para
-      */
+      * ( this->fp ) = LatticeView() ;
+      * ( this->fr ) = LatticeView() ;
 
       // nem baj, ha sokáig kell menni, mert a párhuzamos szálakból a kiválasztott
       // folytatódik, a párhuzamosság a költség, meg ha nem talál, hanem új MPU kell...
 
       int t = m_internal_clock - m_searchingStart;
 
+      MORGAN maxSamuQl = search ( reality, predictions, t );
+
+      if ( m_replay && !maxSamuQl )
+        {
+          maxSamuQl = replay ( reality, predictions, t );
+        }
+
+
       if ( t > m_maxLearningTime || maxSamuQl )
         {
 
+          qDebug() << "   SENSITIZATION MONITOR:"
+                   << m_internal_clock
+                   << "(searching work, MPU-ticks)"
+                   << m_searchWork - m_searchWorkStart
+                   << "of"
+                   << m_exhaustiveWork - m_exhaustiveWorkStart
+                   << "candidates left"
+                   << m_candidates.size();
+
           if ( !maxSamuQl )
             {
-              m_morgan = newMPU();
+              m_morgan = newMPU ( m_provisional );
+
+              if ( m_warmStart && !m_provisional )
+                {
+                  warm_start();
+                }
+
+              TRACE_INSTANT ( "new MPU", ChromeTrace::arg ( "mpu", get_foobar ( ) ) );
 
               qDebug() << "   SENSITIZATION MONITOR:"
                        << m_internal_clock
                        << "MPU-notion:" << get_foobar ( ).c_str()
-                       << "(new MPU, searching time)"
+                       << ( m_provisional ? "(new speculatively trained MPU, searching time)" : "(new MPU, searching time)" )
                        << t;
 
+              m_provisional = nullptr;
+
             }
           else
             {
               m_morgan = maxSamuQl;
 
+              delete m_provisional;
+              m_provisional = nullptr;
+
+              TRACE_INSTANT ( "recognized MPU", ChromeTrace::arg ( "mpu", get_foobar ( ) ) );
+
               qDebug() << "   SENSITIZATION MONITOR:"
                        << m_internal_clock
                        << "MPU-notion:" << get_foobar ( ).c_str()
@@ -1004,6 +1067,8 @@ void SamuBrain::learning ( char **reality, char **predictions, char ***fp, char
 
             }
 
+          recognized ( m_morgan );
+
           init_MPUs ( true );
 
           m_searching = false;
@@ -1026,6 +1091,17 @@ void SamuBrain::learning ( char **reality, char **predictions, char ***fp, char
       //sum = pred ( reality, predictions, !searching, vsum ); //!haveAlreadyLearnt, vsum );
       sum = pred ( reality, predictions, m_haveAlreadyLearnt?5:0, vsum );
 
+      // an MPU that has not been chosen by a search (the first one and the
+      // imprinted ones) gets the keys of the first frames of its learning
+      if ( !m_haveAlreadyLearnt && m_internal_clock - m_haveAlreadyLearntTime <= rank_window )
+        {
+          Recognition & recognition = m_recognitions[m_morgan];
+          if ( !recognition.count )
+            {
+              collect_keys ( reality, recognition.keys );
+            }
+        }
+
       double mon {-1.0};
       Habituation& h = m_morgan->getHabituation();
       m_habituation = h.is_habituation ( vsum, sum, mon );
@@ -1078,10 +1154,13 @@ void SamuBrain::learning ( char **reality, char **predictions, char ***fp, char
                        << m_internal_clock
                        << "(new input detected)";
 
+              TRACE_INSTANT ( "sensitization", "" );
+
               m_searching = true;
               m_searchingStart = m_internal_clock;
 
               init_MPUs ( false );
+              start_search();
 
             }
 
@@ -1095,6 +1174,299 @@ void SamuBrain::learning ( char **reality, char **predictions, char ***fp, char
 
 }
 
+void SamuBrain::imprint ()
+{
+  m_morgan = newMPU();
+
+  init_MPUs ( true );
+
+  m_searching = false;
+  m_haveAlreadyLearnt = false;
+  m_haveAlreadyLearntTime = m_internal_clock;
+}
+
+void SamuBrain::start_search ()
+{
+  m_candidates.clear();
+
+  for ( auto& mpu : m_brain )
+    {
+      m_candidates.push_back ( Candidate {mpu.first, mpu.second, 0, 0} );
+    }
+
+  m_searchKeys.clear();
+  m_replayHashes.clear();
+
+  if ( m_speculative && !m_provisional )
+    {
+      m_provisional = new MentalProcessingUnit ( m_habituations, m_w, m_h );
+    }
+
+  m_searchWorkStart = m_searchWork;
+  m_exhaustiveWorkStart = m_exhaustiveWork;
+}
+
+void SamuBrain::rank ()
+{
+  int maxCount {1};
+
+  for ( auto& recognition : m_recognitions )
+    {
+      maxCount = std::max ( maxCount, recognition.second.count );
+    }
+
+  std::vector<std::pair<double, Candidate>> ranked;
+
+  for ( auto& candidate : m_candidates )
+    {
+      double score {0.0};
+
+      auto it = m_recognitions.find ( candidate.mpu );
+      if ( it != m_recognitions.end() )
+        {
+          const Recognition & recognition = it->second;
+
+          // an MPU that got its keys while learning but was never recognized has no recency
+          double recency = recognition.last < 0 ? 0.0
+                           : 1.0 / ( 1.0 + ( double ) ( m_internal_clock - recognition.last ) / recency_scale );
+          double frequency = ( double ) recognition.count / maxCount;
+
+          score = recency + frequency + similarity ( recognition.keys, m_searchKeys );
+        }
+
+      ranked.push_back ( std::make_pair ( score, candidate ) );
+    }
+
+  // the order of the brain is kept among the same scores
+  std::stable_sort ( ranked.begin(), ranked.end(),
+                     [] ( const std::pair<double, Candidate> & a, const std::pair<double, Candidate> & b )
+  {
+    return a.first < b.first;
+  } );
+
+  int from = m_searchCutoff > 0 ? std::max ( 0, ( int ) ranked.size() - m_searchCutoff ) : 0;
+
+  m_candidates.clear();
+  for ( int i {from}; i < ( int ) ranked.size(); ++i )
+    {
+      m_candidates.push_back ( ranked[i].second );
+    }
+
+  qDebug() << "   SENSITIZATION MONITOR:"
+           << m_internal_clock
+           << "(ranking) top-ranked"
+           << m_candidates.back().name.c_str()
+           << "score"
+           << ranked.back().first
+           << "candidates"
+           << m_candidates.size()
+           << "of"
+           << ranked.size();
+}
+
+MORGAN SamuBrain::replay ( LatticeView reality, LatticeView predictions, int & t )
+{
+  int k = m_replayHashes.size();
+
+  if ( k == m_replayCapacity )
+    {
+      return nullptr;
+    }
+
+  LatticeView frame = m_replayFrames.rows ( k*m_h, m_h );
+
+  // FNV-1a
+  std::size_t hash {14695981039346656037ULL};
+
+  for ( int r {0}; r<m_h; ++r )
+    {
+      std::memcpy ( frame[r], reality[r], m_w );
+
+      for ( int c {0}; c<m_w; ++c )
+        {
+          hash = ( hash ^ ( unsigned char ) frame[r][c] ) * 1099511628211ULL;
+        }
+    }
+
+  m_replayHashes.push_back ( hash );
+
+  int period = replay_period();
+
+  if ( !period )
+    {
+      return nullptr;
+    }
+
+  qDebug() << "   SENSITIZATION MONITOR:"
+           << m_internal_clock
+           << "(replay) period"
+           << period
+           << "buffered frames"
+           << k+1;
+
+  // the input goes on periodically, so the next live frames are the ones
+  // of the last period that are replayed until the search decides
+  MORGAN maxSamuQl {nullptr};
+
+  for ( int i {k+1-period}; !maxSamuQl && t <= m_maxLearningTime; )
+    {
+      ++t;
+      maxSamuQl = search ( m_replayFrames.rows ( i*m_h, m_h ), predictions, t );
+
+      if ( ++i > k )
+        {
+          i -= period;
+        }
+    }
+
+  return maxSamuQl;
+}
+
+int SamuBrain::replay_period () const
+{
+  int k = m_replayHashes.size() - 1;
+
+  // the last p+1 frames must repeat the ones p frames before, so two blank
+  // frames in a row are not taken for a period of 1
+  for ( int p {1}; 2*p <= k; ++p )
+    {
+      bool periodic {true};
+
+      for ( int i {0}; i<=p && periodic; ++i )
+        {
+          periodic = m_replayHashes[k-i] == m_replayHashes[k-i-p];
+        }
+
+      if ( periodic )
+        {
+          return p;
+        }
+    }
+
+  return 0;
+}
+
+void SamuBrain::collect_keys ( LatticeView reality, std::set<unsigned long long> & keys ) const
+{
+  for ( int r {0}; r<m_h; ++r )
+    {
+      for ( int c {0}; c<m_w; ++c )
+        {
+          keys.insert ( context_key ( r, c, reality ) );
+        }
+    }
+}
+
+double SamuBrain::similarity ( const std::set<unsigned long long> & a, const std::set<unsigned long long> & b )
+{
+  std::vector<unsigned long long> common;
+  std::set_intersection ( a.begin(), a.end(), b.begin(), b.end(), std::back_inserter ( common ) );
+
+  return common.empty() ? 0.0 : ( double ) common.size() / ( a.size() + b.size() - common.size() );
+}
+
+void SamuBrain::warm_start ()
+{
+#ifdef Q_LOOKUP_TABLE
+  MORGAN seed {nullptr};
+  double max {warm_start_similarity};
+
+  for ( auto& recognition : m_recognitions )
+    {
+      double s = similarity ( recognition.second.keys, m_searchKeys );
+
+      if ( recognition.first != m_morgan && s >= max )
+        {
+          seed = recognition.first;
+          max = s;
+        }
+    }
+
+  if ( seed )
+    {
+      m_morgan->seed ( *seed );
+
+      qDebug() << "   SENSITIZATION MONITOR:"
+               << m_internal_clock
+               << "(warm start) from"
+               << get_foobar ( seed ).c_str()
+               << "similarity"
+               << max;
+    }
+#endif
+}
+
+void SamuBrain::recognized ( MORGAN morgan )
+{
+  Recognition & recognition = m_recognitions[morgan];
+
+  ++recognition.count;
+  recognition.last = m_internal_clock;
+
+  if ( recognition.keys.empty() )
+    {
+      recognition.keys = m_searchKeys;
+    }
+}
+
+void SamuBrain::race ()
+{
+  auto radius = [] ( const Candidate & candidate )
+  {
+    return std::sqrt ( std::log ( 2.0 / race_delta ) / ( 2.0 * candidate.vsum ) );
+  };
+
+  double lead {0.0};
+
+  for ( auto& candidate : m_candidates )
+    {
+      if ( candidate.vsum )
+        {
+          double ratio = ( double ) candidate.sum / ( double ) candidate.vsum;
+          lead = std::max ( lead, ratio - radius ( candidate ) );
+        }
+    }
+
+  std::vector<Candidate> candidates;
+
+  for ( auto& candidate : m_candidates )
+    {
+      double ratio = candidate.vsum ? ( double ) candidate.sum / ( double ) candidate.vsum : 1.0;
+
+      if ( !candidate.vsum || ratio + radius ( candidate ) >= lead )
+        {
+          candidates.push_back ( candidate );
+        }
+      else
+        {
+          // a dropped MPU must not converge on its last input
+          candidate.mpu->getHabituation().reset();
+        }
+    }
+
+  qDebug() << "   SENSITIZATION MONITOR:"
+           << m_internal_clock
+           << "(racing) candidates"
+           << candidates.size()
+           << "of"
+           << m_candidates.size();
+
+  m_candidates.swap ( candidates );
+}
+
+#ifdef Q_LOOKUP_TABLE
+void MentalProcessingUnit::seed ( const MentalProcessingUnit & mpu )
+{
+  for ( int r {0}; r<m_h; ++r )
+    {
+      for ( int c {0}; c<m_w; ++c )
+        {
+          m_samuQl[r][c].seed ( mpu.m_samuQl[r][c] );
+        }
+    }
+}
+#endif
+
 void SamuBrain::init_MPUs ( bool ex )
 {
 
@@ -1123,6 +1495,78 @@ void SamuBrain::init_MPUs ( bool ex )
 
 }
 
+#ifdef MEM_PROFILE
+void SamuBrain::mem_profile ()
+{
+  if ( !m_memProfile.is_open() )
+    {
+      const char * fname = std::getenv ( "SAMU_MEM_PROFILE" );
+      m_memProfile.open ( fname ? fname : "SamuVocab.mem.csv" );
+      m_memProfile << "tick,mpu,cell,table,phantom,frqs,rules,bytes,rss,observation" << std::endl;
+    }
+
+  auto row = [&] ( const std::string & mpu, int cell, const QLMemory & m )
+  {
+    m_memProfile << m_internal_clock << ","
+                 << mpu << ","
+                 << cell << ","
+                 << m.table << ","
+                 << m.phantom << ","
+                 << m.frqs << ","
+                 << m.rules << ","
+                 << m.bytes;
+  };
+
+  QLMemory brain;
+
+  for ( auto& mpu : m_brain )
+    {
+      std::string name = mpu.first.substr ( 0, mpu.first.find ( ' ' ) );
+      MPU samuQl = mpu.second->getSamu();
+      QLMemory sum;
+
+      for ( int r {0}; r<m_h; ++r )
+        for ( int c {0}; c<m_w; ++c )
+          {
+            QLMemory m = samuQl[r][c].memory();
+
+            // only the cells that have something are written to keep the series compact
+            if ( m.table || m.frqs || m.rules )
+              {
+                row ( name, r*m_w + c, m );
+                m_memProfile << ",," << std::endl;
+              }
+
+            sum.table += m.table;
+            sum.phantom += m.phantom;
+            sum.frqs += m.frqs;
+            sum.rules += m.rules;
+            sum.bytes += m.bytes;
+          }
+
+      row ( name, -1, sum );
+      m_memProfile << ",," << std::endl;
+
+      brain.table += sum.table;
+      brain.phantom += sum.phantom;
+      brain.frqs += sum.frqs;
+      brain.rules += sum.rules;
+      brain.bytes += sum.bytes;
+    }
+
+  long rss {0};
+  std::ifstream statm ( "/proc/self/statm" );
+  statm >> rss >> rss;
+
+  std::string observation = get_foobar();
+  row ( "*", -1, brain );
+  m_memProfile << "," << rss * sysconf ( _SC_PAGESIZE )
+               << "," << observation.substr ( 0, observation.find ( ' ' ) )
+               << ( m_searching ? " (searching)" : "" )
+               << std::endl;
+}
+#endif
+
 std::string SamuBrain::get_foobar() const
 {
   return get_foobar ( m_morgan );
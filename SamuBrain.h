@@ -55,14 +55,24 @@
 #include <QDebug>
 #include <sstream>
 #include "SamuQl.h"
+#include "SamuTrace.h"
+#include "SamuLattice.h"
+#include "SamuThreads.h"
 #include <vector>
 #include <set>
+#include <map>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
 
-class Habituation
+class MentalProcessingUnit;
+
+// The habituation state of all the MPUs of a brain in a struct of arrays,
+// so the searching branch can update every MPU in one vectorized pass.
+class HabituationBank
 {
-    int mem {0};
-    int err {0};
+public:
 
     static const int convergence_limit {
         //4000
@@ -74,31 +84,94 @@ class Habituation
 
     constexpr static int ma_limit {3};
 
-    int msum[ma_limit];
-    int asum[ma_limit];
+    HabituationBank() {}
+
+    int acquire ( MentalProcessingUnit * owner );
+    void release ( int slot );
+    void clear ( int slot );
+    // clear and also the moving averages, the input and the flags: as a new slot
+    void reset ( int slot );
+
+    void input ( int slot, int vsum, int sum ) {
+        m_vsum[slot] = vsum;
+        m_sum[slot] = sum;
+        m_fed[slot] = true;
+    }
+
+    // updates the slots that got an input since the last update (as the former
+    // per-candidate is_habituation calls) and returns their converged MPUs
+    std::vector<MentalProcessingUnit*> update ();
+    void update ( int from, int to );
+
+    bool is_habituation ( int slot ) const {
+        return m_habi[slot];
+    }
+    bool is_converged ( int slot ) const {
+        return m_converged[slot];
+    }
+    // the bogocertainty of convergence, -1.0 if the last input has not been assessed
+    double monitor ( int slot ) const {
+        return m_mon[slot] < 0 ? -1.0 : ( double ) m_mon[slot] / ( double ) convergence_limit;
+    }
+    bool is_newinput ( int slot, int vsum, int sum ) const {
+        return ( sum < m_masum[slot] ) || ( vsum < m_mavsum[slot] );
+    }
+    int size() const {
+        return m_owner.size();
+    }
 
-    int masum {0};
-    int mavsum {0};
+private:
+
+    HabituationBank ( const HabituationBank & );
+    HabituationBank & operator= ( const HabituationBank & );
+
+    std::vector<int> m_mem, m_err;
+    std::vector<int> m_msum[ma_limit], m_asum[ma_limit];
+    std::vector<int> m_masum, m_mavsum;
+    std::vector<int> m_vsum, m_sum;
+    std::vector<int> m_mon;
+    std::vector<char> m_habi, m_converged, m_fed;
+    std::vector<MentalProcessingUnit*> m_owner;
+    std::vector<int> m_free;
+};
+
+// a slot of the HabituationBank of the brain
+class Habituation
+{
+    HabituationBank & bank;
+    int slot;
 
     Habituation ( const Habituation & );
     Habituation & operator= ( const Habituation & );
 
 public:
 
-    Habituation() {
-        clear();
+    Habituation ( HabituationBank & bank, MentalProcessingUnit * owner ) :
+        bank ( bank ), slot ( bank.acquire ( owner ) ) {
+    }
+    ~Habituation() {
+        bank.release ( slot );
     }
 
+    // the input of the next HabituationBank::update()
+    void input ( int vsum, int sum ) {
+        bank.input ( slot, vsum, sum );
+    }
     bool is_habituation ( int , int , double & );
-    bool is_newinput ( int sum, int vsum );
+    bool is_newinput ( int vsum, int sum ) const {
+        return bank.is_newinput ( slot, vsum, sum );
+    }
+    bool is_converged() const {
+        return bank.is_converged ( slot );
+    }
+    double monitor() const {
+        return bank.monitor ( slot );
+    }
     void clear() {
-        mem = 0;
-        err = 0;
-
-        for ( int ci {0}; ci<ma_limit; ++ci ) {
-            msum[ci] = asum[ci] = 0;
-        }
-
+        bank.clear ( slot );
+    }
+    void reset() {
+        bank.reset ( slot );
     }
 
 };
@@ -111,9 +184,11 @@ class MentalProcessingUnit
     MPU m_samuQl;
     Habituation m_habi;
 
-    char **m_prev;
-    char ** fr;
-    char ** fp;
+    // prev, fp and fr are the three consecutive planes of m_h rows
+    Lattice m_planes;
+    LatticeView m_prev;
+    LatticeView fr;
+    LatticeView fp;
 
     MentalProcessingUnit ( const MentalProcessingUnit & );
     MentalProcessingUnit & operator= ( const MentalProcessingUnit & );
@@ -123,19 +198,19 @@ public:
 
     int sum, vsum;
 
-    MentalProcessingUnit ( int w = 30, int h = 20 );
+    MentalProcessingUnit ( HabituationBank & habituations, int w = 30, int h = 20 );
     ~MentalProcessingUnit();
 
     MPU getSamu() {
         return m_samuQl;
     }
-    char ** getPrev() {
+    LatticeView getPrev() {
         return m_prev;
     }
-    char ** getFp() {
+    LatticeView getFp() {
         return fp;
     }
-    char ** getFr() {
+    LatticeView getFr() {
         return fr;
     }
     Habituation& getHabituation() {
@@ -143,6 +218,12 @@ public:
     }
 
     void cls();
+#ifdef Q_LOOKUP_TABLE
+    // starts from the Q values of mpu (they are copied on the first change)
+    void seed ( const MentalProcessingUnit & mpu );
+#endif
+    // compares the row r of the reality with the previous one, updates fp and adds the matches to sum and vsum
+    void compare ( int r, const char *reality );
 
 };
 
@@ -150,10 +231,21 @@ typedef MentalProcessingUnit* MORGAN;
 
 class SamuBrain
 {
+public:
+
+    // EXHAUSTIVE evaluates every MPU until the search decides, RACING drops
+    // the MPUs whose match ratio sum/vsum is behind the leaders after every window
+    enum SearchStrategy {
+        EXHAUSTIVE,
+        RACING
+    };
+
+private:
 
     int m_w {40};
     int m_h {30};
 
+    HabituationBank m_habituations;
     std::map<std::string, MORGAN> m_brain;
     MORGAN m_morgan;
 
@@ -166,15 +258,95 @@ class SamuBrain
     int m_searchingStart {0};
     bool m_habituation {false};
 
-    MORGAN newMPU ();
-    int pred ( char **reality, char **predictions, int, int & );
-    int pred ( MORGAN, char **reality, char **predictions, int, int & );
-    void apred ( int r, int c, char **reality, char **predictions, int isLearning );
+    // the MPUs that are still evaluated in the current search
+    struct Candidate {
+        std::string name;
+        MORGAN mpu;
+        long sum;
+        long vsum;
+    };
+    std::vector<Candidate> m_candidates;
+
+    SearchStrategy m_searchStrategy {EXHAUSTIVE};
+    static const int race_window {25};
+    // the confidence of the bounds of the match ratios (Hoeffding)
+    constexpr static double race_delta {.01};
+    void start_search ();
+    void race ();
+
+    // the past recognitions of an MPU and the distinct context keys of the
+    // first frames of the search it has won first
+    struct Recognition {
+        int count {0};
+        // the tick of the last recognition, -1 if there was none
+        long last {-1};
+        std::set<unsigned long long> keys;
+    };
+    std::map<MORGAN, Recognition> m_recognitions;
+    std::set<unsigned long long> m_searchKeys;
+
+    // with ranking the candidates are ordered by recency, frequency and key
+    // similarity after the first rank_window ticks of the search, the top-ranked
+    // is the last, and only the top m_searchCutoff ones are evaluated further
+    // (0: all of them)
+    bool m_searchRanked {false};
+    int m_searchCutoff {0};
+    static const int rank_window {25};
+    static const int recency_scale {1000};
+    void rank ();
+    void recognized ( MORGAN morgan );
+    void collect_keys ( LatticeView reality, std::set<unsigned long long> & keys ) const;
+    // the Jaccard similarity of two sets of keys
+    static double similarity ( const std::set<unsigned long long> & a, const std::set<unsigned long long> & b );
+
+    // MPU-ticks of the searches: evaluated and that of the exhaustive scan
+    long m_searchWork {0};
+    long m_exhaustiveWork {0};
+    long m_searchWorkStart {0};
+    long m_exhaustiveWorkStart {0};
+
+    // with replay the frames of the search are buffered, and as soon as they
+    // are found to be periodic the search is finished on the buffered period
+    // without waiting for the live ticks
+    bool m_replay {false};
+    int m_replayCapacity {4*m_w+4};
+    // allocated by setReplay ( true ) only
+    Lattice m_replayFrames {0, 0};
+    std::vector<std::size_t> m_replayHashes;
+    MORGAN replay ( LatticeView reality, LatticeView predictions, int & t );
+    int replay_period () const;
+
+    // with speculation a provisional MPU learns the frames of the search as
+    // one more task of apred, it becomes the new MPU if no MPU is recognized
+    bool m_speculative {false};
+    MORGAN m_provisional {nullptr};
+    Lattice m_provisionalPredictions {m_w, m_h};
+
+    // with warm start a new MPU is seeded from the MPU whose keys are the most
+    // similar to the keys of the search (at least warm_start_similarity)
+    bool m_warmStart {false};
+    constexpr static double warm_start_similarity {.2};
+    void warm_start ();
+
+    MORGAN search ( LatticeView reality, LatticeView predictions, int t );
+    MORGAN newMPU ( MORGAN morgan = nullptr );
+    int pred ( LatticeView reality, LatticeView predictions, int, int & );
+    // verbose is false for the speculative prediction of the provisional MPU,
+    // which runs as a task next to the candidates and must not log per cell
+    int pred ( MORGAN, LatticeView reality, LatticeView predictions, int, int &, bool verbose = true );
+    void apred ( LatticeView reality, LatticeView predictions, int isLearning );
     void init_MPUs ( bool ex );
     std::string get_foobar ( MORGAN ) const;
 
-    char *** fp;
-    char *** fr;
+    LatticeView * fp;
+    LatticeView * fr;
+
+#ifdef MEM_PROFILE
+    // samples the table sizes of all MPUs and cells every m_memPeriod ticks
+    void mem_profile ();
+    std::ofstream m_memProfile;
+    long m_memPeriod {1000};
+#endif
 
 
     SamuBrain ( const SamuBrain & );
@@ -487,13 +659,47 @@ public:
     SamuBrain ( int w = 30, int h = 20 );
     ~SamuBrain();
 
-    void learning ( char **reality, char **predictions, char *** fp, char *** fr );
+    void learning ( LatticeView reality, LatticeView predictions, LatticeView & fp, LatticeView & fr );
+    // starts a new MPU without searching the known ones, e.g. to populate a brain for benchmarks
+    void imprint ();
     int getW() const;
     int getH() const;
     bool isSearching() const;
     int nofMPUs() const;
+
+    SearchStrategy getSearchStrategy() const {
+        return m_searchStrategy;
+    }
+    void setSearchStrategy ( SearchStrategy searchStrategy ) {
+        m_searchStrategy = searchStrategy;
+    }
+    void setWarmStart ( bool warmStart ) {
+        m_warmStart = warmStart;
+    }
+    void setSpeculative ( bool speculative ) {
+        m_speculative = speculative;
+    }
+    void setReplay ( bool replay ) {
+        m_replay = replay;
+
+        if ( m_replay && m_replayFrames.getH() != m_h*m_replayCapacity ) {
+            m_replayFrames.resize ( m_w, m_h*m_replayCapacity );
+        }
+    }
+    void setSearchRanking ( bool ranked, int cutoff = 0 ) {
+        m_searchRanked = ranked;
+        m_searchCutoff = cutoff;
+    }
+    long getSearchWork() const {
+        return m_searchWork;
+    }
+    long getExhaustiveWork() const {
+        return m_exhaustiveWork;
+    }
     std::string get_foobar() const;
 
+    unsigned long long context_key ( int r, int c, LatticeView reality ) const;
+
     bool isHabituation() const {
         return m_habituation;
     }
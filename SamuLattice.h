@@ -0,0 +1,150 @@
+#ifndef SamuLattice_H
+#define SamuLattice_H
+
+/**
+ * @brief Contiguous lattices of cells and non-owning views of them
+ *
+ * @file SamuLattice.h
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * A Lattice owns the h rows of w cells in one allocation, the rows follow
+ * each other with a stride that is rounded up to 16 bytes. A LatticeView
+ * is a pointer, a size and a stride only, it is passed by value between
+ * GameOfLife, SamuBrain, the MPUs and the GUI without copying the cells.
+ * Both can be indexed as lattice[r][c] like the former char** arrays.
+ */
+
+#include <cstring>
+
+class LatticeView
+{
+public:
+
+    LatticeView() {}
+
+    LatticeView ( char *data, int w, int h, int stride ) :
+        m_data ( data ), m_w ( w ), m_h ( h ), m_stride ( stride ) {
+    }
+
+    char * operator[] ( int r ) const {
+        return m_data + r*m_stride;
+    }
+
+    // the rows [r, r+h)
+    LatticeView rows ( int r, int h ) const {
+        return LatticeView ( ( *this ) [r], m_w, h, m_stride );
+    }
+
+    explicit operator bool () const {
+        return m_data != nullptr;
+    }
+
+    char * data() const {
+        return m_data;
+    }
+    int getW() const {
+        return m_w;
+    }
+    int getH() const {
+        return m_h;
+    }
+    int getStride() const {
+        return m_stride;
+    }
+
+private:
+
+    char *m_data {nullptr};
+    int m_w {0};
+    int m_h {0};
+    int m_stride {0};
+};
+
+class Lattice
+{
+public:
+
+    Lattice ( int w, int h ) :
+        m_w ( w ), m_h ( h ), m_stride ( ( w+15 ) /16*16 ) {
+        m_data = new char[m_h*m_stride];
+        clear();
+    }
+
+    ~Lattice() {
+        delete [] m_data;
+    }
+
+    char * operator[] ( int r ) {
+        return m_data + r*m_stride;
+    }
+    const char * operator[] ( int r ) const {
+        return m_data + r*m_stride;
+    }
+
+    LatticeView view() const {
+        return LatticeView ( m_data, m_w, m_h, m_stride );
+    }
+    LatticeView rows ( int r, int h ) const {
+        return view().rows ( r, h );
+    }
+
+    // a new lattice of h rows of w cells (the cells are cleared)
+    void resize ( int w, int h ) {
+        delete [] m_data;
+
+        m_w = w;
+        m_h = h;
+        m_stride = ( w+15 ) /16*16;
+        m_data = new char[m_h*m_stride];
+        clear();
+    }
+
+    void clear() {
+        fill ( 0 );
+    }
+    void fill ( char c ) {
+        std::memset ( m_data, c, m_h*m_stride );
+    }
+
+    int getW() const {
+        return m_w;
+    }
+    int getH() const {
+        return m_h;
+    }
+    int getStride() const {
+        return m_stride;
+    }
+
+private:
+
+    Lattice ( const Lattice & );
+    Lattice & operator= ( const Lattice & );
+
+    int m_w;
+    int m_h;
+    int m_stride;
+    char *m_data;
+};
+
+#endif
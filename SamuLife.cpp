@@ -60,15 +60,17 @@ SamuLife::SamuLife ( int w, int h, QWidget *parent ) : QMainWindow ( parent )
 else
   setFixedSize ( QSize ( 2*w*m_cw, 80) );
   
+  qRegisterMetaType<LatticeView> ( "LatticeView" );
+
   gameOfLife = new GameOfLife ( w, h );
   gameOfLife->start();
 
-  connect ( gameOfLife, SIGNAL ( cellsChanged ( char **, char **, char **, char ** ) ),
-            this, SLOT ( updateCells ( char **, char **, char **, char ** ) ) );
+  connect ( gameOfLife, SIGNAL ( cellsChanged ( LatticeView, LatticeView, LatticeView, LatticeView ) ),
+            this, SLOT ( updateCells ( LatticeView, LatticeView, LatticeView, LatticeView ) ) );
 
 }
 
-void SamuLife::updateCells ( char **lattice, char **prediction, char **fp, char** fr )
+void SamuLife::updateCells ( LatticeView lattice, LatticeView prediction, LatticeView fp, LatticeView fr )
 {
   this->lattice = lattice;
   this->prediction = prediction;
@@ -8,6 +8,10 @@
 DEFINES += LIFEOFGAME
 #DEFINES += SARSA
 DEFINES += Q_LOOKUP_TABLE
+#DEFINES += PHASE_TIMERS
+#DEFINES += CHROME_TRACE
+#DEFINES += MEM_PROFILE
+#DEFINES += FAST_SIGMOID
 
 QT += widgets core
 CONFIG += c++14
@@ -19,5 +23,5 @@ TARGET = SamuVocab
 INCLUDEPATH += .
 
 # Input
-HEADERS += SamuBrain.h GameOfLife.h SamuLife.h SamuQl.h
+HEADERS += SamuBrain.h GameOfLife.h SamuLife.h SamuQl.h SamuProf.h SamuTrace.h SamuLattice.h SamuThreads.h
 SOURCES +=  main.cpp SamuLife.cpp GameOfLife.cpp SamuBrain.cpp
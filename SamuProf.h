@@ -0,0 +1,281 @@
+#ifndef SamuProf_H
+#define SamuProf_H
+
+/**
+ * @brief Scoped hot-path timers with latency histograms
+ *
+ * @file SamuProf.h
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * The timers are compiled in only if PHASE_TIMERS is defined (see SamuLife.pro),
+ * otherwise PHASE_TIMER and PHASE_TICK expand to nothing.
+ *
+ * Every phase has two log-linear (HDR-style) histograms: one for the latency
+ * of the single calls and one for the time spent in the phase during a whole
+ * tick. The histograms are dumped to stderr at exit or after a SIGUSR1:
+ *
+ * tail -f out|grep "PHASE TIMER MONITOR"
+ * kill -USR1 `pidof SamuVocab`
+ */
+
+#ifdef PHASE_TIMERS
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+class LatencyHistogram
+{
+public:
+
+    // 2^sub_bits sub-buckets per octave, so the relative error is below 1/32
+    constexpr static int sub_bits {5};
+    constexpr static int sub_buckets {1<<sub_bits};
+    constexpr static int nof_buckets {sub_buckets* ( 64-sub_bits+1 )};
+
+    LatencyHistogram() {
+        clear();
+    }
+
+    void record ( unsigned long long ns ) {
+        counts[index ( ns )].fetch_add ( 1, std::memory_order_relaxed );
+        n.fetch_add ( 1, std::memory_order_relaxed );
+
+        unsigned long long m = mx.load ( std::memory_order_relaxed );
+        while ( ns > m && !mx.compare_exchange_weak ( m, ns, std::memory_order_relaxed ) )
+            ;
+    }
+
+    unsigned long long count() const {
+        return n.load ( std::memory_order_relaxed );
+    }
+
+    unsigned long long max() const {
+        return mx.load ( std::memory_order_relaxed );
+    }
+
+    // the upper bound of the bucket that holds the p-th percentile
+    unsigned long long percentile ( double p ) const {
+        unsigned long long all = count();
+        if ( !all ) {
+            return 0;
+        }
+
+        unsigned long long rank = ( unsigned long long ) ( p / 100.0 * all + .5 );
+        if ( rank < 1 ) {
+            rank = 1;
+        }
+
+        unsigned long long acc {0};
+        for ( int i {0}; i<nof_buckets; ++i ) {
+            acc += counts[i].load ( std::memory_order_relaxed );
+            if ( acc >= rank ) {
+                unsigned long long ub = upper ( i );
+                return ub < max() ? ub : max();
+            }
+        }
+
+        return max();
+    }
+
+    void clear() {
+        for ( int i {0}; i<nof_buckets; ++i ) {
+            counts[i].store ( 0, std::memory_order_relaxed );
+        }
+        n.store ( 0, std::memory_order_relaxed );
+        mx.store ( 0, std::memory_order_relaxed );
+    }
+
+private:
+
+    LatencyHistogram ( const LatencyHistogram & );
+    LatencyHistogram & operator= ( const LatencyHistogram & );
+
+    static int index ( unsigned long long v ) {
+        if ( v < sub_buckets ) {
+            return v;
+        }
+
+        int msb = 63 - __builtin_clzll ( v );
+        int shift = msb - sub_bits;
+
+        return ( shift+1 ) * sub_buckets + ( int ) ( ( v >> shift ) - sub_buckets );
+    }
+
+    static unsigned long long upper ( int i ) {
+        if ( i < sub_buckets ) {
+            return i;
+        }
+
+        int shift = i / sub_buckets - 1;
+        unsigned long long base = ( unsigned long long ) ( sub_buckets + i % sub_buckets ) << shift;
+
+        return base + ( ( 1ull << shift ) - 1 );
+    }
+
+    std::atomic<unsigned long long> counts[nof_buckets];
+    std::atomic<unsigned long long> n;
+    std::atomic<unsigned long long> mx;
+};
+
+class PhaseProfiler
+{
+public:
+
+    enum Phase {
+        DEVELOPMENT,
+        LEARNING,
+        APRED,
+        PRED,
+        QL_STEP,
+        HABITUATION,
+        NOF_PHASES
+    };
+
+    static PhaseProfiler & instance() {
+        // never destroyed, it is still used by the atexit handler
+        static PhaseProfiler * profiler = new PhaseProfiler;
+        return *profiler;
+    }
+
+    void record ( Phase phase, unsigned long long ns ) {
+        calls[phase].record ( ns );
+        inTick[phase].fetch_add ( ns, std::memory_order_relaxed );
+    }
+
+    // closes the current tick, it must be called once per tick from the tick thread
+    void tick() {
+        for ( int i {0}; i<NOF_PHASES; ++i ) {
+            unsigned long long ns = inTick[i].exchange ( 0, std::memory_order_relaxed );
+            if ( ns ) {
+                ticks[i].record ( ns );
+            }
+        }
+
+        if ( dumpRequest().exchange ( false ) ) {
+            dump();
+        }
+    }
+
+    void dump() {
+        static const char * names[NOF_PHASES] = {
+            "GameOfLife::development",
+            "SamuBrain::learning",
+            "SamuBrain::apred",
+            "SamuBrain::pred",
+            "QL::operator()",
+            "Habituation::is_habituation"
+        };
+
+        std::cerr << std::fixed << std::setprecision ( 3 );
+        for ( int i {0}; i<NOF_PHASES; ++i ) {
+            std::cerr << "   PHASE TIMER MONITOR: "
+                      << names[i]
+                      << " calls " << calls[i].count()
+                      << " call p50 " << us ( calls[i].percentile ( 50.0 ) )
+                      << " p99 " << us ( calls[i].percentile ( 99.0 ) )
+                      << " max " << us ( calls[i].max() )
+                      << " us ticks " << ticks[i].count()
+                      << " tick p50 " << us ( ticks[i].percentile ( 50.0 ) )
+                      << " p99 " << us ( ticks[i].percentile ( 99.0 ) )
+                      << " max " << us ( ticks[i].max() )
+                      << " us"
+                      << std::endl;
+        }
+        std::cerr << std::defaultfloat;
+    }
+
+private:
+
+    PhaseProfiler() {
+        for ( int i {0}; i<NOF_PHASES; ++i ) {
+            inTick[i].store ( 0, std::memory_order_relaxed );
+        }
+
+        std::signal ( SIGUSR1, onSignal );
+        std::atexit ( onExit );
+    }
+
+    PhaseProfiler ( const PhaseProfiler & );
+    PhaseProfiler & operator= ( const PhaseProfiler & );
+
+    static double us ( unsigned long long ns ) {
+        return ns / 1000.0;
+    }
+
+    static std::atomic<bool> & dumpRequest() {
+        static std::atomic<bool> request {false};
+        return request;
+    }
+
+    // only a flag is set here, the dump itself is done at the end of the next tick
+    static void onSignal ( int ) {
+        dumpRequest().store ( true );
+    }
+
+    static void onExit() {
+        instance().dump();
+    }
+
+    LatencyHistogram calls[NOF_PHASES];
+    LatencyHistogram ticks[NOF_PHASES];
+    std::atomic<unsigned long long> inTick[NOF_PHASES];
+};
+
+class PhaseTimer
+{
+public:
+
+    explicit PhaseTimer ( PhaseProfiler::Phase phase ) :
+        phase ( phase ), start ( std::chrono::steady_clock::now() ) {
+    }
+
+    ~PhaseTimer() {
+        PhaseProfiler::instance().record ( phase,
+                                           std::chrono::duration_cast<std::chrono::nanoseconds> (
+                                               std::chrono::steady_clock::now() - start ).count() );
+    }
+
+private:
+
+    PhaseTimer ( const PhaseTimer & );
+    PhaseTimer & operator= ( const PhaseTimer & );
+
+    PhaseProfiler::Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define PHASE_TIMER(phase) PhaseTimer phase_timer ( PhaseProfiler::phase )
+#define PHASE_TICK() PhaseProfiler::instance().tick()
+
+#else
+
+#define PHASE_TIMER(phase)
+#define PHASE_TICK()
+
+#endif
+
+#endif
@@ -57,6 +57,269 @@
 #include <limits>
 #include <fstream>
 #include <cstring>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include "SamuProf.h"
+#include "SamuThreads.h"
+
+// the vector kernels shared by the perceptrons
+struct PerceptronKernels {
+
+    // eight partial sums, so the additions do not wait for each other (it is
+    // vectorized by the compiler, the omp simd reduction uses one accumulator)
+    template <typename Real>
+    static Real dot ( const Real *w, const Real *x, int n ) {
+        Real s0 {0}, s1 {0}, s2 {0}, s3 {0}, s4 {0}, s5 {0}, s6 {0}, s7 {0};
+        int m = n / 8 * 8;
+
+        for ( int k = 0; k < m; k += 8 ) {
+            s0 += w[k] * x[k];
+            s1 += w[k+1] * x[k+1];
+            s2 += w[k+2] * x[k+2];
+            s3 += w[k+3] * x[k+3];
+            s4 += w[k+4] * x[k+4];
+            s5 += w[k+5] * x[k+5];
+            s6 += w[k+6] * x[k+6];
+            s7 += w[k+7] * x[k+7];
+        }
+
+        Real sum = ( ( s0 + s1 ) + ( s2 + s3 ) ) + ( ( s4 + s5 ) + ( s6 + s7 ) );
+
+        for ( int k = m; k < n; ++k ) {
+            sum += w[k] * x[k];
+        }
+
+        return sum;
+    }
+
+    // y += a*x
+    template <typename Real>
+    static void axpy ( Real a, const Real *x, Real *y, int n ) {
+        #pragma omp simd
+        for ( int k = 0; k < n; ++k ) {
+            y[k] += a * x[k];
+        }
+    }
+
+    // the dot product of quantized vectors, accumulated in 32 bits
+    static int qdot ( const std::int8_t *w, const std::int8_t *x, int n ) {
+        int sum {0};
+
+        #pragma omp simd reduction ( +:sum )
+        for ( int k = 0; k < n; ++k ) {
+            sum += w[k] * x[k];
+        }
+
+        return sum;
+    }
+
+    // q = round ( v / scale ) where the scale maps the largest |v| to 127
+    template <typename Real>
+    static double quantize ( const Real *v, std::int8_t *q, int n ) {
+        double max {0.0};
+
+        for ( int k = 0; k < n; ++k ) {
+            max = std::max ( max, ( double ) std::fabs ( v[k] ) );
+        }
+
+        double scale = max > 0.0 ? max / 127.0 : 1.0;
+
+        for ( int k = 0; k < n; ++k ) {
+            q[k] = ( std::int8_t ) std::lrint ( v[k] / scale );
+        }
+
+        return scale;
+    }
+
+    // e^x by the Taylor polynomial of degree 13 of e^r, where x = n ln2 + r and
+    // |r| <= ln2/2, times 2^n built in the exponent bits; the relative error is
+    // below 5e-16 (2 ulps) in [-708, 708], it saturates at 2^-1022 and 2^1023
+    // outside (for |x| < 2^50), and it has no branches and no calls, so the
+    // loops of the layers are vectorized by the compiler
+    static double exp_approx ( double x ) {
+        const double log2e {1.4426950408889634};
+        const double ln2_hi {6.93147180369123816490e-01};
+        const double ln2_lo {1.90821492927058770002e-10};
+        // 1.5*2^52: t - shifter is x*log2e rounded to an integer, which is also
+        // in the low bits of t
+        const double shifter {6755399441055744.0};
+        const std::int64_t shifter_bits {0x4338000000000000LL};
+
+        double t = x * log2e + shifter;
+        double n = t - shifter;
+        double r = ( x - n * ln2_hi ) - n * ln2_lo;
+
+        // the terms paired by Estrin's scheme, the pairs are independent of each
+        // other (unlike in Horner's), so they are computed in parallel
+        double r2 = r * r, r4 = r2 * r2, r8 = r4 * r4;
+
+        double c0 = 1.0 + r;
+        double c1 = 1.0 / 2.0 + r * ( 1.0 / 6.0 );
+        double c2 = 1.0 / 24.0 + r * ( 1.0 / 120.0 );
+        double c3 = 1.0 / 720.0 + r * ( 1.0 / 5040.0 );
+        double c4 = 1.0 / 40320.0 + r * ( 1.0 / 362880.0 );
+        double c5 = 1.0 / 3628800.0 + r * ( 1.0 / 39916800.0 );
+        double c6 = 1.0 / 479001600.0 + r * ( 1.0 / 6227020800.0 );
+
+        double p = ( ( c0 + r2 * c1 ) + r4 * ( c2 + r2 * c3 ) ) + r8 * ( ( c4 + r2 * c5 ) + r4 * c6 );
+
+        std::int64_t bits;
+        std::memcpy ( &bits, &t, sizeof bits );
+        bits -= shifter_bits;
+
+        // n clamped to [-1022, 1023] by masks: the comparisons of doubles (by
+        // -ftrapping-math) and of 64-bit integers (in SSE2) are not vectorized
+        std::int64_t low = - ( std::int64_t ) ( ( std::uint64_t ) ( bits + 1022 ) >> 63 );
+        std::int64_t high = - ( std::int64_t ) ( ( std::uint64_t ) ( 1023 - bits ) >> 63 );
+        bits = ( bits & ~ ( low | high ) ) | ( -1022 & low ) | ( 1023 & high );
+        bits = ( bits + 1023 ) << 52;
+
+        double scale;
+        std::memcpy ( &scale, &bits, sizeof scale );
+
+        return p * scale;
+    }
+
+    // the activation of the perceptrons, by exp_approx with FAST_SIGMOID
+    static double sigmoid ( double x ) {
+#ifdef FAST_SIGMOID
+        return 1.0/ ( 1.0 + exp_approx ( -x ) );
+#else
+        return 1.0/ ( 1.0 + exp ( -x ) );
+#endif
+    }
+
+    // u = sigmoid ( u ), the units of a layer
+    static void activate ( double *u, long n ) {
+        #pragma omp simd
+        for ( long k = 0; k < n; ++k ) {
+            u[k] = sigmoid ( u[k] );
+        }
+    }
+
+    // the factors of the errors of the units u in the backpropagation,
+    // sigmoid ( u ) * ( 1 - sigmoid ( u ) ), with one sigmoid per unit
+    static void derive ( const double *u, double *d, long n ) {
+        #pragma omp simd
+        for ( long k = 0; k < n; ++k ) {
+            double a = sigmoid ( u[k] );
+
+            d[k] = a * ( 1.0-a );
+        }
+    }
+
+    // the indices of the non-zero elements of x (in increasing order)
+    static int gather ( const double *x, int n, int *index ) {
+        int nnz {0};
+
+        for ( int k = 0; k < n; ++k ) {
+            index[nnz] = k;
+            nnz += x[k] != 0.0;
+        }
+
+        return nnz;
+    }
+
+    // dot ( w, x, n ) where only x[index[0..nnz)] are non-zero: the products
+    // are added to the same partial sums in the same order as in dot, so the
+    // result is the same to the last bit
+    template <typename Real>
+    static Real sparse_dot ( const Real *w, const Real *x, const int *index, int nnz, int n ) {
+        Real s[8] {};
+        int m = n / 8 * 8;
+        int t {0};
+
+        for ( ; t < nnz && index[t] < m; ++t ) {
+            s[index[t] & 7] += w[index[t]] * x[index[t]];
+        }
+
+        Real sum = ( ( s[0] + s[1] ) + ( s[2] + s[3] ) ) + ( ( s[4] + s[5] ) + ( s[6] + s[7] ) );
+
+        for ( ; t < nnz; ++t ) {
+            sum += w[index[t]] * x[index[t]];
+        }
+
+        return sum;
+    }
+
+    // axpy ( a, x, y ) where only x[index[0..nnz)] are non-zero
+    template <typename Real>
+    static void sparse_axpy ( Real a, const Real *x, const int *index, int nnz, Real *y ) {
+        for ( int t = 0; t < nnz; ++t ) {
+            y[index[t]] += a * x[index[t]];
+        }
+    }
+
+    // the dot products of w and four vectors, w is loaded once for the four
+    static void dot4 ( const double *w, const double * const x[4], int n, double d[4] ) {
+        const double *x0 = x[0], *x1 = x[1], *x2 = x[2], *x3 = x[3];
+        double s0 {0.0}, s1 {0.0}, s2 {0.0}, s3 {0.0};
+
+        #pragma omp simd reduction ( +:s0,s1,s2,s3 )
+        for ( int k = 0; k < n; ++k ) {
+            s0 += w[k] * x0[k];
+            s1 += w[k] * x1[k];
+            s2 += w[k] * x2[k];
+            s3 += w[k] * x3[k];
+        }
+
+        d[0] = s0;
+        d[1] = s1;
+        d[2] = s2;
+        d[3] = s3;
+    }
+
+    // y += a[0]*x[0] + ... + a[3]*x[3], y is loaded and stored once for the four
+    static void axpy4 ( const double a[4], const double * const x[4], double *y, int n ) {
+        const double *x0 = x[0], *x1 = x[1], *x2 = x[2], *x3 = x[3];
+        double a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+
+        #pragma omp simd
+        for ( int k = 0; k < n; ++k ) {
+            y[k] += a0 * x0[k] + a1 * x1[k] + a2 * x2[k] + a3 * x3[k];
+        }
+    }
+
+    // u[s*stride] = w times the sample s, for the samples (the rows of x,
+    // batch x n), four samples at a time
+    static void batch_forward ( const double *w, const double *x, int n, int batch, double *u, int stride ) {
+        int s {0};
+
+        for ( ; s + 4 <= batch; s += 4 ) {
+            const double * xs[4] {x + ( long ) s*n, x + ( long ) ( s+1 ) *n, x + ( long ) ( s+2 ) *n, x + ( long ) ( s+3 ) *n};
+            double d[4];
+
+            dot4 ( w, xs, n, d );
+
+            for ( int t {0}; t < 4; ++t ) {
+                u[ ( s+t ) *stride] = d[t];
+            }
+        }
+
+        for ( ; s < batch; ++s ) {
+            u[s*stride] = dot ( w, x + ( long ) s*n, n );
+        }
+    }
+
+    // w += rate * e[s*stride] * the sample s, for the samples (the rows of x)
+    static void batch_update ( double *w, const double *x, int n, int batch, double rate, const double *e, int stride ) {
+        int s {0};
+
+        for ( ; s + 4 <= batch; s += 4 ) {
+            const double * xs[4] {x + ( long ) s*n, x + ( long ) ( s+1 ) *n, x + ( long ) ( s+2 ) *n, x + ( long ) ( s+3 ) *n};
+            double a[4] {rate * e[s*stride], rate * e[ ( s+1 ) *stride], rate * e[ ( s+2 ) *stride], rate * e[ ( s+3 ) *stride]};
+
+            axpy4 ( a, xs, w, n );
+        }
+
+        for ( ; s < batch; ++s ) {
+            axpy ( rate * e[s*stride], x + ( long ) s*n, w, n );
+        }
+    }
+};
 
 class Perceptron
 {
@@ -64,7 +327,6 @@ public:
     Perceptron ( int nof, ... ) {
         n_layers = nof;
 
-        units = new double*[n_layers];
         n_units = new int[n_layers];
 
         va_list vap;
@@ -73,220 +335,1320 @@ public:
 
         for ( int i {0}; i < n_layers; ++i ) {
             n_units[i] = va_arg ( vap, int );
+        }
+
+        va_end ( vap );
+
+        allocate();
+
+#ifndef RND_DEBUG
+        std::random_device init;
+        std::default_random_engine gen {init() };
+#else
+        std::default_random_engine gen;
+#endif
+
+        std::uniform_real_distribution<double> dist ( -1.0, 1.0 );
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            for ( int j {0}; j < n_units[i]; ++j ) {
+                double *w = row ( i, j );
+
+                for ( int k {0}; k < n_units[i-1]; ++k ) {
+                    w[k] = dist ( gen );
+                }
+            }
+        }
+    }
+
+    Perceptron ( std::fstream & file ) {
+        file >> n_layers;
+
+        n_units = new int[n_layers];
+
+        for ( int i {0}; i < n_layers; ++i ) {
+            file >> n_units[i];
+        }
+
+        allocate();
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            for ( int j {0}; j < n_units[i]; ++j ) {
+                double *w = row ( i, j );
+
+                for ( int k {0}; k < n_units[i-1]; ++k ) {
+                    file >> w[k];
+                }
+            }
+        }
+    }
+
+
+    // the arithmetic of the weights: FLOAT keeps them in single precision for
+    // both training and inference, INT8 is the inference of frozen networks by
+    // 8-bit weights (a scale per row) and inputs (a scale per layer), learning
+    // updates the double weights then and quantizes the changed rows again
+    enum Precision {
+        DOUBLE,
+        FLOAT,
+        INT8
+    };
+
+    void setPrecision ( Precision p ) {
+        if ( p == precision ) {
+            return;
+        }
+
+        to_double();
+
+        precision = p;
+
+        std::vector<float>().swap ( fweights );
+        std::vector<std::int8_t>().swap ( qweights );
+
+        if ( precision == FLOAT ) {
+            fweights.resize ( n_weights );
+            finputs.resize ( input_offsets[n_layers-1] );
+        } else if ( precision == INT8 ) {
+            qweights.resize ( n_weights );
+            qscales.resize ( first_rows[n_layers-1] );
+            qinputs.resize ( input_offsets[n_layers-1] );
+            qinput_scales.resize ( n_layers-1 );
+        }
+
+        from_double();
+    }
+
+    Precision getPrecision() const {
+        return precision;
+    }
+
+    double sigmoid ( double x ) {
+        return PerceptronKernels::sigmoid ( x );
+    }
+
+
+    double operator() ( double image [] ) {
+
+        input ( image );
+
+        for ( int i {1}; i < n_layers; ++i ) {
+
+#ifdef CUDA_PRCPS
+
+            //cuda_layer ( i, n_units, units, weights );
+
+#else
+
+            forward ( i );
+
+#endif
+
+        }
+
+        return sigmoid ( units[n_layers - 1][0] );
+
+    }
+
+    // operator() in two parts for ActionBank: the units of the first layer one
+    // by one, then the other layers
+    int first_units() const {
+        return n_units[1];
+    }
+
+    int inputs() const {
+        return n_units[0];
+    }
+
+    // the image of the next first_unit calls (converted once if not DOUBLE)
+    void first_input ( double image [] ) {
+        input ( image );
+
+        if ( precision != DOUBLE ) {
+            prepare ( 1 );
+        }
+    }
+
+    // the sum of the unit j, the layer is activated by forward_rest
+    void first_unit ( double [], int j ) {
+        units[1][j] = row_dot ( 1, j );
+    }
+
+    double forward_rest ( double image [] ) {
+
+        units[0] = image;
+
+        PerceptronKernels::activate ( units[1], n_units[1] );
+        derived = false;
+
+        for ( int i {2}; i < n_layers; ++i ) {
+            forward ( i );
+        }
+
+        return sigmoid ( units[n_layers - 1][0] );
+    }
+
+    // the units and the converted inputs of a const forward pass, owned by the
+    // caller (one per thread), they grow to the largest network they are used by
+    struct Workspace {
+        std::vector<double> units;
+        std::vector<float> finputs;
+        std::vector<std::int8_t> qinputs;
+        std::vector<int> active;
+    };
+
+    // operator() that does not change the network: the units are computed in
+    // the workspace, so threads with their own workspaces can evaluate the same
+    // network at once (as long as it is not learning), the value is the same
+    double operator() ( const double image [], Workspace & workspace ) const {
+        // the vectors are checked one by one: a workspace of a deep network
+        // may have enough units but too few inputs for a wide one
+        if ( ( long ) workspace.units.size() < first_rows[n_layers-1] ) {
+            workspace.units.resize ( first_rows[n_layers-1] );
+        }
+        if ( ( long ) workspace.finputs.size() < input_offsets[n_layers-1] ) {
+            workspace.finputs.resize ( input_offsets[n_layers-1] );
+        }
+        if ( ( long ) workspace.qinputs.size() < input_offsets[n_layers-1] ) {
+            workspace.qinputs.resize ( input_offsets[n_layers-1] );
+        }
+        if ( ( int ) workspace.active.size() < n_units[0] ) {
+            workspace.active.resize ( n_units[0] );
+        }
+
+        const double *x = image;
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            double *u = workspace.units.data() + first_rows[i-1];
+
+            forward ( i, x, u, workspace );
+            x = u;
+        }
+
+        return PerceptronKernels::sigmoid ( x[0] );
+    }
+
+    void learning ( double image [], double q, double prev_q ) {
+        double y[1] {q};
+
+        learning ( image, y );
+    }
+
+    void learning ( double image [], double y[] ) {
+        //( *this ) ( image );
+
+        input ( image );
+
+        if ( precision != DOUBLE ) {
+            prepare ( 1 );
+        }
+
+        backpropagation ( y, false );
+
+    }
+
+    double train ( double image [], double q, double ) {
+        double y[1] {q};
+
+        return train ( image, y );
+    }
+
+    // learning ( image, y ) and then operator() ( image ) fused: the rows of the
+    // first layer are updated and multiplied by the image while they are in the
+    // cache, so the weights are read once per training iteration
+    double train ( double image [], double y[] ) {
+
+        input ( image );
+
+        if ( precision != DOUBLE ) {
+            prepare ( 1 );
+        }
+
+        backpropagation ( y, true );
+
+        for ( int i {n_layers > 2 ? 2 : 1}; i < n_layers; ++i ) {
+            forward ( i );
+        }
+
+        return sigmoid ( units[n_layers - 1][0] );
+    }
+
+    // a mini-batch training step: the samples (the rows of images, batch x
+    // n_units[0], and of y) are propagated by the same weights, then the mean of
+    // their updates is applied, so the rows of the layers are read once per
+    // batch instead of once per sample (unlike learning, the errors of the
+    // hidden layers are computed by the weights before the update)
+    void learning_batch ( const double images [], const double y[], int batch ) {
+        long width = batch_offset ( n_layers, batch );
+
+        // the batches are computed by the double weights
+        to_double();
+
+        if ( ( long ) batch_units.size() < width ) {
+            batch_units.resize ( width );
+            batch_derivs.resize ( width );
+            batch_backs.resize ( width );
+        }
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            int rows = n_units[i];
+            int cols = n_units[i-1];
+            const double *x = i > 1 ? batch_units.data() + batch_offset ( i-1, batch ) : images;
+            double *u = batch_units.data() + batch_offset ( i, batch );
+            double *d = batch_derivs.data() + batch_offset ( i, batch );
+
+            #pragma omp parallel for num_threads ( SamuThreads::budget() ) \
+                if ( SamuThreads::dispatch ( rows, ( long ) batch * cols ) == SamuThreads::PARALLEL )
+            for ( int j = 0; j < rows; ++j ) {
+                PerceptronKernels::batch_forward ( row ( i, j ), x, cols, batch, u + j, rows );
+            }
+
+            PerceptronKernels::activate ( u, ( long ) batch * rows );
+            PerceptronKernels::derive ( u, d, ( long ) batch * rows );
+        }
+
+        for ( int i {n_layers-1}; i >0 ; --i ) {
+            int rows = n_units[i];
+            const double *u = batch_units.data() + batch_offset ( i, batch );
+            const double *d = batch_derivs.data() + batch_offset ( i, batch );
+            double *e = batch_backs.data() + batch_offset ( i, batch );
+
+            for ( int s {0}; s < batch; ++s ) {
+                double *back = e + s*rows;
+
+                if ( i == n_layers-1 ) {
+                    for ( int j {0}; j < rows; ++j ) {
+                        back[j] = y[s*rows + j] - u[s*rows + j];
+                    }
+                } else {
+                    int next = n_units[i+1];
+                    const double *next_e = batch_backs.data() + batch_offset ( i+1, batch ) + s*next;
+
+                    std::fill ( back, back + rows, 0.0 );
+
+                    for ( int l {0}; l < next; ++l ) {
+                        PerceptronKernels::axpy ( 0.19*next_e[l], row ( i+1, l ), back, rows );
+                    }
+                }
+
+                for ( int j {0}; j < rows; ++j ) {
+                    back[j] *= d[s*rows + j];
+                }
+            }
+        }
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            int rows = n_units[i];
+            int cols = n_units[i-1];
+            const double *x = i > 1 ? batch_units.data() + batch_offset ( i-1, batch ) : images;
+            const double *e = batch_backs.data() + batch_offset ( i, batch );
+            double rate = ( i == n_layers-1 ? 0.2 : 0.19 ) / batch;
+
+            #pragma omp parallel for num_threads ( SamuThreads::budget() ) \
+                if ( SamuThreads::dispatch ( rows, ( long ) batch * cols ) == SamuThreads::PARALLEL )
+            for ( int j = 0; j < rows; ++j ) {
+                PerceptronKernels::batch_update ( row ( i, j ), x, cols, batch, rate, e + j, rows );
+            }
+        }
+
+        from_double();
+    }
+
+    ~Perceptron() {
+        for ( int i {0}; i < n_layers; ++i ) {
+            if ( i ) {
+                delete [] units[i];
+            }
+        }
+
+        delete [] units;
+        delete [] backs[0];
+        delete [] backs;
+        delete [] derivs[0];
+        delete [] derivs;
+        delete [] block;
+        delete [] offsets;
+        delete [] strides;
+        delete [] first_rows;
+        delete [] input_offsets;
+        delete [] n_units;
+
+    }
+
+    void save ( std::fstream & out ) {
+        to_double();
+
+        out << " "
+            << n_layers;
+
+        for ( int i {0}; i < n_layers; ++i ) {
+            out << " " << n_units[i];
+        }
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            for ( int j {0}; j < n_units[i]; ++j ) {
+                double *w = row ( i, j );
+
+                for ( int k {0}; k < n_units[i-1]; ++k ) {
+                    out << " "
+                        << w[k];
+
+                }
+            }
+        }
+
+    }
+
+private:
+    Perceptron ( const Perceptron & );
+    Perceptron & operator= ( const Perceptron & );
+
+    // the rows of the weight matrices are aligned to 64 bytes (8 doubles)
+    static const int align {8};
+    // the first layer is computed by the sparse kernels if at most one input
+    // in sparse_ratio is non-zero
+    static const int sparse_ratio {4};
+
+    // the weights of all the layers are stored in one block, layer by layer, the
+    // row j of the layer i (the weights of its unit j) is padded to strides[i-1]
+    void allocate() {
+        units = new double*[n_layers];
+        active.resize ( n_units[0] );
+        backs = new double*[n_layers-1];
+        derivs = new double*[n_layers-1];
+        offsets = new long[n_layers-1];
+        strides = new int[n_layers-1];
+        first_rows = new long[n_layers];
+        input_offsets = new long[n_layers];
+
+        long size {0};
+        long errors {0};
+
+        first_rows[0] = 0;
+        input_offsets[0] = 0;
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            units[i] = new double [n_units[i]];
+            errors += n_units[i];
+
+            strides[i-1] = ( n_units[i-1] + align-1 ) / align * align;
+            offsets[i-1] = size;
+            size += ( long ) n_units[i] * strides[i-1];
+
+            first_rows[i] = first_rows[i-1] + n_units[i];
+            input_offsets[i] = input_offsets[i-1] + strides[i-1];
+        }
+
+        n_weights = size;
+
+        // the errors and the derivatives of the layers i > 0 (backs[i-1] and
+        // derivs[i-1]) in one workspace each
+        backs[0] = new double[errors];
+        derivs[0] = new double[errors];
+
+        for ( int i {1}; i < n_layers-1; ++i ) {
+            backs[i] = backs[i-1] + n_units[i];
+            derivs[i] = derivs[i-1] + n_units[i];
+        }
+
+        block = new double[size + align];
+        weights = reinterpret_cast<double *> ( ( reinterpret_cast<std::uintptr_t> ( block ) + align*sizeof ( double ) - 1 )
+                                               & ~ ( std::uintptr_t ) ( align*sizeof ( double ) - 1 ) );
+        std::fill ( weights, weights + size, 0.0 );
+    }
+
+    // the errors and the updates of the weights, the output layer first, if
+    // fused, the units of the first layer are recomputed by the updated rows
+    void backpropagation ( double y[], bool fused ) {
+        if ( !derived ) {
+            for ( int i {1}; i < n_layers; ++i ) {
+                PerceptronKernels::derive ( units[i], derivs[i-1], n_units[i] );
+            }
+
+            derived = true;
+        }
+
+        int i {n_layers-1};
+
+        for ( int j {0}; j < n_units[i]; ++j ) {
+            backs[i-1][j] = derivs[i-1][j] * ( y[j] - units[i][j] );
+
+            row_axpy ( i, j, 0.2* backs[i-1][j] );
+        }
+
+        for ( int i {n_layers-2}; i >0 ; --i ) {
+
+            double *back = backs[i-1];
+            bool recompute = fused && i == 1;
+
+            // the errors of the layer i: the transposed (already updated) weights
+            // of the layer i+1 times its errors, row by row
+            std::fill ( back, back + n_units[i], 0.0 );
+
+            for ( int l = 0; l < n_units[i+1]; ++l ) {
+                row_to ( i+1, l, 0.19*backs[i][l], back );
+            }
+
+            if ( SamuThreads::dispatch ( n_units[i], n_units[i-1] ) == SamuThreads::PARALLEL ) {
+                #pragma omp parallel for num_threads ( SamuThreads::budget() )
+                for ( int j =0; j < n_units[i]; ++j ) {
+                    backward ( i, j, back, recompute );
+                }
+            } else {
+                for ( int j =0; j < n_units[i]; ++j ) {
+                    backward ( i, j, back, recompute );
+                }
+            }
+
+            if ( recompute ) {
+                PerceptronKernels::activate ( units[i], n_units[i] );
+                derived = false;
+            }
+        }
+    }
+
+    // units[i] = sigmoid ( the weights of the layer i times units[i-1] )
+    void forward ( int i ) {
+        int rows = n_units[i];
+        int cols = n_units[i-1];
+
+        if ( precision != DOUBLE || ( i == 1 && n_active >= 0 ) ) {
+            prepare ( i );
+
+            if ( SamuThreads::dispatch ( rows, i == 1 && n_active >= 0 ? n_active : cols ) == SamuThreads::PARALLEL ) {
+                #pragma omp parallel for num_threads ( SamuThreads::budget() )
+                for ( int j = 0; j < rows; ++j ) {
+                    units[i][j] = row_dot ( i, j );
+                }
+            } else {
+                for ( int j = 0; j < rows; ++j ) {
+                    units[i][j] = row_dot ( i, j );
+                }
+            }
+
+            PerceptronKernels::activate ( units[i], rows );
+            derived = false;
+
+            return;
+        }
+
+        switch ( SamuThreads::dispatch ( rows, cols ) ) {
+        case SamuThreads::PARALLEL:
+            #pragma omp parallel for num_threads ( SamuThreads::budget() )
+            for ( int j = 0; j < rows; ++j ) {
+                units[i][j] = PerceptronKernels::dot ( row ( i, j ), units[i-1], cols );
+            }
+            break;
+
+        case SamuThreads::SIMD:
+            for ( int j = 0; j < rows; ++j ) {
+                units[i][j] = PerceptronKernels::dot ( row ( i, j ), units[i-1], cols );
+            }
+            break;
+
+        case SamuThreads::SCALAR:
+            for ( int j = 0; j < rows; ++j ) {
+                double *w = row ( i, j );
+                double sum {0.0};
+
+                for ( int k = 0; k < cols; ++k ) {
+                    sum += w[k] * units[i-1][k];
+                }
+
+                units[i][j] = sum;
+            }
+            break;
+        }
+
+        PerceptronKernels::activate ( units[i], rows );
+        derived = false;
+    }
+
+    // the error of the unit j of the hidden layer i and the update of its weights
+    // (and the sum of the unit by the updated weights if recompute)
+    void backward ( int i, int j, double *back, bool recompute ) {
+        back[j] = derivs[i-1][j] * back[j];
+
+        row_axpy ( i, j, 0.19* back[j] );
+
+        if ( recompute ) {
+            units[i][j] = row_dot ( i, j );
+        }
+    }
+
+    // forward ( i ) for the const operator(): u = sigmoid ( the weights of the
+    // layer i times x ) by the kernels of forward ( i ), with the inputs
+    // converted in the workspace
+    void forward ( int i, const double *x, double *u, Workspace & workspace ) const {
+        int rows = n_units[i];
+        int cols = n_units[i-1];
+        float *fx = workspace.finputs.data() + input_offsets[i-1];
+        std::int8_t *qx = workspace.qinputs.data() + input_offsets[i-1];
+        int *active = workspace.active.data();
+        int nnz {-1};
+        double qscale {1.0};
+
+        if ( i == 1 && precision != INT8 ) {
+            nnz = PerceptronKernels::gather ( x, cols, active );
+
+            if ( nnz * sparse_ratio > cols ) {
+                nnz = -1;
+            }
+        }
+
+        if ( precision == FLOAT ) {
+            for ( int k = 0; k < cols; ++k ) {
+                fx[k] = ( float ) x[k];
+            }
+        } else if ( precision == INT8 ) {
+            qscale = PerceptronKernels::quantize ( x, qx, cols );
+        }
+
+        auto row_sum = [&] ( int j ) -> double {
+            if ( precision == FLOAT ) {
+                return nnz >= 0 ? PerceptronKernels::sparse_dot ( frow ( i, j ), ( const float * ) fx, active, nnz, cols )
+                       : PerceptronKernels::dot ( frow ( i, j ), ( const float * ) fx, cols );
+            } else if ( precision == INT8 ) {
+                return qscales[first_rows[i-1] + j] * qscale * PerceptronKernels::qdot ( qrow ( i, j ), qx, cols );
+            } else if ( nnz >= 0 ) {
+                return PerceptronKernels::sparse_dot ( ( const double * ) row ( i, j ), x, active, nnz, cols );
+            } else if ( cols < SamuThreads::simd_cols ) {
+                const double *w = row ( i, j );
+                double sum {0.0};
+
+                for ( int k = 0; k < cols; ++k ) {
+                    sum += w[k] * x[k];
+                }
+
+                return sum;
+            } else {
+                return PerceptronKernels::dot ( ( const double * ) row ( i, j ), x, cols );
+            }
+        };
+
+        if ( SamuThreads::dispatch ( rows, nnz >= 0 ? nnz : cols ) == SamuThreads::PARALLEL ) {
+            #pragma omp parallel for num_threads ( SamuThreads::budget() )
+            for ( int j = 0; j < rows; ++j ) {
+                u[j] = row_sum ( j );
+            }
+        } else {
+            for ( int j = 0; j < rows; ++j ) {
+                u[j] = row_sum ( j );
+            }
+        }
+
+        PerceptronKernels::activate ( u, rows );
+    }
+
+    // the image of the first layer, and its non-zero inputs if they are few
+    // enough (e.g. the one-hot characters of CHARACTER_CONSOLE), then the
+    // kernels of the first layer touch only their columns (not in INT8)
+    void input ( double image [] ) {
+        units[0] = image;
+        n_active = -1;
+
+        if ( precision != INT8 ) {
+            int nnz = PerceptronKernels::gather ( image, n_units[0], active.data() );
+
+            if ( nnz * sparse_ratio <= n_units[0] ) {
+                n_active = nnz;
+            }
+        }
+    }
+
+    // the input of the layer i (units[i-1]) in the arithmetic of the weights
+    void prepare ( int i ) {
+        if ( precision == FLOAT ) {
+            float *x = finputs.data() + input_offsets[i-1];
+
+            if ( i == 1 && n_active >= 0 ) {
+                std::fill ( x, x + n_units[0], 0.0f );
+
+                for ( int t = 0; t < n_active; ++t ) {
+                    x[active[t]] = ( float ) units[0][active[t]];
+                }
+            } else {
+                for ( int k = 0; k < n_units[i-1]; ++k ) {
+                    x[k] = ( float ) units[i-1][k];
+                }
+            }
+        } else if ( precision == INT8 ) {
+            qinput_scales[i-1] = PerceptronKernels::quantize ( units[i-1], qinputs.data() + input_offsets[i-1], n_units[i-1] );
+        }
+    }
+
+    // the row j of the layer i times its (prepared) input
+    double row_dot ( int i, int j ) {
+        int n = n_units[i-1];
+
+        if ( i == 1 && n_active >= 0 ) {
+            if ( precision == FLOAT ) {
+                return PerceptronKernels::sparse_dot ( frow ( 1, j ), ( const float * ) finputs.data(), active.data(), n_active, n );
+            } else {
+                return PerceptronKernels::sparse_dot ( row ( 1, j ), ( const double * ) units[0], active.data(), n_active, n );
+            }
+        }
+
+        switch ( precision ) {
+        case FLOAT:
+            return PerceptronKernels::dot ( frow ( i, j ), ( const float * ) finputs.data() + input_offsets[i-1], n );
+
+        case INT8:
+            return qscales[first_rows[i-1] + j] * qinput_scales[i-1]
+                   * PerceptronKernels::qdot ( qrow ( i, j ), qinputs.data() + input_offsets[i-1], n );
+
+        default:
+            return PerceptronKernels::dot ( row ( i, j ), units[i-1], n );
+        }
+    }
+
+    // the row j of the layer i += a times its (prepared) input
+    void row_axpy ( int i, int j, double a ) {
+        int n = n_units[i-1];
+
+        if ( i == 1 && n_active >= 0 ) {
+            if ( precision == FLOAT ) {
+                PerceptronKernels::sparse_axpy ( ( float ) a, ( const float * ) finputs.data(), active.data(), n_active, frow ( 1, j ) );
+            } else {
+                PerceptronKernels::sparse_axpy ( a, ( const double * ) units[0], active.data(), n_active, row ( 1, j ) );
+            }
+        } else if ( precision == FLOAT ) {
+            PerceptronKernels::axpy ( ( float ) a, ( const float * ) finputs.data() + input_offsets[i-1], frow ( i, j ), n );
+        } else {
+            PerceptronKernels::axpy ( a, units[i-1], row ( i, j ), n );
+
+            if ( precision == INT8 ) {
+                qscales[first_rows[i-1] + j] = PerceptronKernels::quantize ( row ( i, j ), qrow ( i, j ), n );
+            }
+        }
+    }
+
+    // y += a times the row j of the layer i
+    void row_to ( int i, int j, double a, double *y ) {
+        int n = n_units[i-1];
+
+        if ( precision == FLOAT ) {
+            const float *w = frow ( i, j );
+
+            for ( int k = 0; k < n; ++k ) {
+                y[k] += a * w[k];
+            }
+        } else {
+            PerceptronKernels::axpy ( a, row ( i, j ), y, n );
+        }
+    }
+
+    // the float weights back to the double ones (FLOAT)
+    void to_double() {
+        if ( precision == FLOAT ) {
+            std::copy ( fweights.begin(), fweights.end(), weights );
+        }
+    }
+
+    // the weights of the precision from the double ones
+    void from_double() {
+        if ( precision == FLOAT ) {
+            std::copy ( weights, weights + n_weights, fweights.begin() );
+        } else if ( precision == INT8 ) {
+            for ( int i {1}; i < n_layers; ++i ) {
+                for ( int j {0}; j < n_units[i]; ++j ) {
+                    qscales[first_rows[i-1] + j] = PerceptronKernels::quantize ( row ( i, j ), qrow ( i, j ), n_units[i-1] );
+                }
+            }
+        }
+    }
+
+    double * row ( int i, int j ) const {
+        return weights + offsets[i-1] + ( long ) j * strides[i-1];
+    }
+
+    float * frow ( int i, int j ) {
+        return fweights.data() + offsets[i-1] + ( long ) j * strides[i-1];
+    }
+
+    const float * frow ( int i, int j ) const {
+        return fweights.data() + offsets[i-1] + ( long ) j * strides[i-1];
+    }
+
+    std::int8_t * qrow ( int i, int j ) {
+        return qweights.data() + offsets[i-1] + ( long ) j * strides[i-1];
+    }
+
+    const std::int8_t * qrow ( int i, int j ) const {
+        return qweights.data() + offsets[i-1] + ( long ) j * strides[i-1];
+    }
+
+    // the first unit of the layer i > 0 in the workspaces of learning_batch
+    long batch_offset ( int i, int batch ) const {
+        long first {0};
+
+        for ( int l {1}; l < i; ++l ) {
+            first += n_units[l];
+        }
+
+        return first * batch;
+    }
+
+    int n_layers;
+    int* n_units;
+    double **units;
+    double **backs;
+    // the factors of the errors of the units (PerceptronKernels::derive), they
+    // are computed once per forward pass by the first backpropagation after it
+    double **derivs;
+    bool derived {false};
+    double *block;
+    double *weights;
+    long *offsets;
+    int *strides;
+    long n_weights;
+    // the first row of the layer i+1 and the first unit of the input of the
+    // layer i+1 in the workspaces of the reduced precisions
+    long *first_rows;
+    long *input_offsets;
+    std::vector<double> batch_units;
+    std::vector<double> batch_derivs;
+    std::vector<double> batch_backs;
+    Precision precision {DOUBLE};
+    std::vector<float> fweights;
+    std::vector<float> finputs;
+    std::vector<std::int8_t> qweights;
+    std::vector<double> qscales;
+    std::vector<std::int8_t> qinputs;
+    std::vector<double> qinput_scales;
+    // the indices of the non-zero inputs of the image, n_active is -1 if the
+    // first layer is computed by the dense kernels
+    std::vector<int> active;
+    int n_active {-1};
+
+};
+
+// the same network as Perceptron with its topology fixed at compile time, e.g.
+// FixedPerceptron<2, 6, 1> instead of Perceptron ( 3, 2, 6, 1 ): the weights,
+// the activations and the errors are arrays of the object, the loops of the
+// layers have constant trip counts (the small ones are unrolled by the
+// compiler) and the calls of the layers are resolved at compile time
+template <int... Layers>
+class FixedPerceptron
+{
+public:
+    static constexpr int n_layers {sizeof... ( Layers ) };
+
+    static constexpr int size ( int i ) {
+        const int n_units[] {Layers...};
+        return n_units[i];
+    }
+
+    FixedPerceptron() {
+#ifndef RND_DEBUG
+        std::random_device init;
+        std::default_random_engine gen {init() };
+#else
+        std::default_random_engine gen;
+#endif
+
+        std::uniform_real_distribution<double> dist ( -1.0, 1.0 );
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            for ( int j {0}; j < size ( i ); ++j ) {
+                double *w = row ( i, j );
+
+                for ( int k {0}; k < size ( i-1 ); ++k ) {
+                    w[k] = dist ( gen );
+                }
+            }
+        }
+    }
+
+    // the format of Perceptron::save, the topology of the file must be Layers:
+    // otherwise the failbit of the file is set and the weights are zero
+    FixedPerceptron ( std::fstream & file ) {
+        int n {0};
+
+        file >> n;
+
+        bool same {n == n_layers};
+
+        for ( int i {0}; same && i < n_layers; ++i ) {
+            file >> n;
+            same = n == size ( i );
+        }
+
+        if ( !file || !same ) {
+            std::cerr << "FixedPerceptron: the topology of the file is not the one of the template"
+                      << std::endl;
+
+            std::fill ( weights, weights + weights_offset ( n_layers ), 0.0 );
+            file.setstate ( std::ios::failbit );
+            return;
+        }
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            for ( int j {0}; j < size ( i ); ++j ) {
+                double *w = row ( i, j );
+
+                for ( int k {0}; k < size ( i-1 ); ++k ) {
+                    file >> w[k];
+                }
+            }
+        }
+    }
+
+    double sigmoid ( double x ) {
+        return PerceptronKernels::sigmoid ( x );
+    }
+
+    double operator() ( double image [] ) {
+        input = image;
+
+        forward ( input, units, std::integral_constant<int, 1>() );
+        derived = false;
+
+        return sigmoid ( layer ( n_layers-1 ) [0] );
+    }
+
+    // the units of a const forward pass, as Perceptron::Workspace
+    struct Workspace {
+        std::vector<double> units;
+    };
+
+    // as the const Perceptron::operator()
+    double operator() ( const double image [], Workspace & workspace ) const {
+        workspace.units.resize ( offset ( n_layers ) );
+
+        forward ( image, workspace.units.data(), std::integral_constant<int, 1>() );
+
+        return PerceptronKernels::sigmoid ( workspace.units[offset ( n_layers-1 )] );
+    }
+
+    // the small networks are always computed in double
+    void setPrecision ( Perceptron::Precision ) {
+    }
+
+    int first_units() const {
+        return size ( 1 );
+    }
+
+    int inputs() const {
+        return size ( 0 );
+    }
+
+    void first_input ( double [] ) {
+    }
+
+    void first_unit ( double image [], int j ) {
+        const int cols {size ( 0 ) };
+
+        units[j] = PerceptronKernels::dot ( row ( 1, j ), image, cols );
+    }
+
+    double forward_rest ( double image [] ) {
+        input = image;
+
+        PerceptronKernels::activate ( units, size ( 1 ) );
+
+        forward ( input, units, std::integral_constant<int, 2>() );
+        derived = false;
+
+        return sigmoid ( layer ( n_layers-1 ) [0] );
+    }
+
+    void learning ( double image [], double q, double ) {
+        double y[1] {q};
+
+        learning ( image, y );
+    }
+
+    void learning ( double image [], double y[] ) {
+        input = image;
+
+        if ( !derived ) {
+            PerceptronKernels::derive ( units, derivs, offset ( n_layers ) );
+            derived = true;
+        }
+
+        const int i {n_layers-1};
+        double *u = units + offset ( i );
+        double *d = derivs + offset ( i );
+        double *back = backs + offset ( i );
+
+        for ( int j {0}; j < size ( i ); ++j ) {
+            back[j] = d[j] * ( y[j] - u[j] );
+
+            PerceptronKernels::axpy ( 0.2* back[j], layer ( i-1 ), row ( i, j ), size ( i-1 ) );
+        }
+
+        backward ( std::integral_constant<int, n_layers-2>() );
+    }
+
+    double train ( double image [], double q, double ) {
+        double y[1] {q};
+
+        return train ( image, y );
+    }
+
+    // learning ( image, y ) and then operator() ( image )
+    double train ( double image [], double y[] ) {
+        learning ( image, y );
+
+        forward ( input, units, std::integral_constant<int, 1>() );
+        derived = false;
+
+        return sigmoid ( layer ( n_layers-1 ) [0] );
+    }
+
+    // Perceptron::learning_batch
+    void learning_batch ( const double images [], const double y[], int batch ) {
+        long width = ( long ) batch * offset ( n_layers );
+
+        if ( ( long ) batch_units.size() < width ) {
+            batch_units.resize ( width );
+            batch_derivs.resize ( width );
+            batch_backs.resize ( width );
+        }
+
+        for ( int i {1}; i < n_layers; ++i ) {
+            const int rows {size ( i ) }, cols {size ( i-1 ) };
+            const double *x = i > 1 ? batch_units.data() + ( long ) batch * offset ( i-1 ) : images;
+            double *u = batch_units.data() + ( long ) batch * offset ( i );
 
-            if ( i ) {
-                units[i] = new double [n_units[i]];
+            for ( int j {0}; j < rows; ++j ) {
+                PerceptronKernels::batch_forward ( row ( i, j ), x, cols, batch, u + j, rows );
             }
-        }
 
-        va_end ( vap );
+            PerceptronKernels::activate ( u, ( long ) batch * rows );
+            PerceptronKernels::derive ( u, batch_derivs.data() + ( long ) batch * offset ( i ), ( long ) batch * rows );
+        }
 
-        weights = new double**[n_layers-1];
+        for ( int i {n_layers-1}; i >0 ; --i ) {
+            const int rows {size ( i ) };
+            const double *u = batch_units.data() + ( long ) batch * offset ( i );
+            const double *d = batch_derivs.data() + ( long ) batch * offset ( i );
+            double *e = batch_backs.data() + ( long ) batch * offset ( i );
 
-#ifndef RND_DEBUG
-        std::random_device init;
-        std::default_random_engine gen {init() };
-#else
-        std::default_random_engine gen;
-#endif
+            for ( int s {0}; s < batch; ++s ) {
+                double *back = e + s*rows;
 
-        std::uniform_real_distribution<double> dist ( -1.0, 1.0 );
+                if ( i == n_layers-1 ) {
+                    for ( int j {0}; j < rows; ++j ) {
+                        back[j] = y[s*rows + j] - u[s*rows + j];
+                    }
+                } else {
+                    const int next {size ( i+1 ) };
+                    const double *next_e = batch_backs.data() + ( long ) batch * offset ( i+1 ) + s*next;
 
-        for ( int i {1}; i < n_layers; ++i ) {
-            weights[i-1] = new double *[n_units[i]];
+                    std::fill ( back, back + rows, 0.0 );
 
-            for ( int j {0}; j < n_units[i]; ++j ) {
-                weights[i-1][j] = new double [n_units[i-1]];
+                    for ( int l {0}; l < next; ++l ) {
+                        PerceptronKernels::axpy ( 0.19*next_e[l], row ( i+1, l ), back, rows );
+                    }
+                }
 
-                for ( int k {0}; k < n_units[i-1]; ++k ) {
-                    weights[i-1][j][k] = dist ( gen );
+                for ( int j {0}; j < rows; ++j ) {
+                    back[j] *= d[s*rows + j];
                 }
             }
         }
-    }
 
-    Perceptron ( std::fstream & file ) {
-        file >> n_layers;
-
-        units = new double*[n_layers];
-        n_units = new int[n_layers];
-
-        for ( int i {0}; i < n_layers; ++i ) {
-            file >> n_units[i];
+        for ( int i {1}; i < n_layers; ++i ) {
+            const int rows {size ( i ) }, cols {size ( i-1 ) };
+            const double *x = i > 1 ? batch_units.data() + ( long ) batch * offset ( i-1 ) : images;
+            const double *e = batch_backs.data() + ( long ) batch * offset ( i );
+            double rate = ( i == n_layers-1 ? 0.2 : 0.19 ) / batch;
 
-            if ( i ) {
-                units[i] = new double [n_units[i]];
+            for ( int j {0}; j < rows; ++j ) {
+                PerceptronKernels::batch_update ( row ( i, j ), x, cols, batch, rate, e + j, rows );
             }
         }
+    }
+
+    void save ( std::fstream & out ) {
+        out << " "
+            << n_layers;
 
-        weights = new double**[n_layers-1];
+        for ( int i {0}; i < n_layers; ++i ) {
+            out << " " << size ( i );
+        }
 
         for ( int i {1}; i < n_layers; ++i ) {
-            weights[i-1] = new double *[n_units[i]];
+            for ( int j {0}; j < size ( i ); ++j ) {
+                double *w = row ( i, j );
 
-            for ( int j {0}; j < n_units[i]; ++j ) {
-                weights[i-1][j] = new double [n_units[i-1]];
+                for ( int k {0}; k < size ( i-1 ); ++k ) {
+                    out << " "
+                        << w[k];
 
-                for ( int k {0}; k < n_units[i-1]; ++k ) {
-                    file >> weights[i-1][j][k];
                 }
             }
         }
+
     }
 
+private:
 
-    double sigmoid ( double x ) {
-        return 1.0/ ( 1.0 + exp ( -x ) );
-    }
+    // the first unit of the layer i > 0 in units (and in backs)
+    static constexpr int offset ( int i ) {
+        int o {0};
 
+        for ( int l {1}; l < i; ++l ) {
+            o += size ( l );
+        }
 
-    double operator() ( double image [] ) {
+        return o;
+    }
 
-        units[0] = image;
+    // the first weight of the layer i > 0 in weights
+    static constexpr int weights_offset ( int i ) {
+        int o {0};
 
-        for ( int i {1}; i < n_layers; ++i ) {
+        for ( int l {1}; l < i; ++l ) {
+            o += size ( l ) * size ( l-1 );
+        }
 
-#ifdef CUDA_PRCPS
+        return o;
+    }
 
-            //cuda_layer ( i, n_units, units, weights );
+    // the layers from i on of the image in out (the units of the layer l at
+    // offset ( l ), the units of the network or of a Workspace): the units of
+    // the layer i = sigmoid ( its weights times the units of the layer i-1 ),
+    // the sums are those of Perceptron::forward
+    template <int i>
+    void forward ( const double *image, double *out, std::integral_constant<int, i> ) const {
+        const int rows {size ( i ) }, cols {size ( i-1 ) };
+        const double *x = i > 1 ? out + offset ( i-1 ) : image;
+        double *u = out + offset ( i );
+
+        for ( int j {0}; j < rows; ++j ) {
+            if ( cols < SamuThreads::simd_cols ) {
+                const double *w = row ( i, j );
+                double sum {0.0};
+
+                for ( int k {0}; k < cols; ++k ) {
+                    sum += w[k] * x[k];
+                }
 
-#else
+                u[j] = sum;
+            } else {
+                u[j] = PerceptronKernels::dot ( row ( i, j ), x, cols );
+            }
+        }
 
-            #pragma omp parallel for
-            for ( int j = 0; j < n_units[i]; ++j ) {
-                units[i][j] = 0.0;
+        PerceptronKernels::activate ( u, rows );
 
-                for ( int k = 0; k < n_units[i-1]; ++k ) {
-                    units[i][j] += weights[i-1][j][k] * units[i-1][k];
-                }
+        forward ( image, out, std::integral_constant<int, i+1>() );
+    }
 
-                units[i][j] = sigmoid ( units[i][j] );
+    void forward ( const double *, double *, std::integral_constant<int, n_layers> ) const {
+    }
 
-            }
+    // the errors of the hidden layer i and the update of its weights, as in
+    // Perceptron::learning
+    template <int i>
+    void backward ( std::integral_constant<int, i> ) {
+        const int rows {size ( i ) }, cols {size ( i-1 ) };
+        const double *d = derivs + offset ( i );
+        double *back = backs + offset ( i );
+        const double *next = backs + offset ( i+1 );
 
-#endif
+        std::fill ( back, back + rows, 0.0 );
 
+        for ( int l {0}; l < size ( i+1 ); ++l ) {
+            PerceptronKernels::axpy ( 0.19*next[l], row ( i+1, l ), back, rows );
         }
 
-        return sigmoid ( units[n_layers - 1][0] );
+        for ( int j {0}; j < rows; ++j ) {
+            back[j] = d[j] * back[j];
 
-    }
+            PerceptronKernels::axpy ( 0.19* back[j], layer ( i-1 ), row ( i, j ), cols );
+        }
 
-    void learning ( double image [], double q, double prev_q ) {
-        double y[1] {q};
+        backward ( std::integral_constant<int, i-1>() );
+    }
 
-        learning ( image, y );
+    void backward ( std::integral_constant<int, 0> ) {
     }
 
-    void learning ( double image [], double y[] ) {
-        //( *this ) ( image );
+    const double * layer ( int i ) const {
+        return i ? units + offset ( i ) : input;
+    }
 
-        units[0] = image;
+    double * row ( int i, int j ) {
+        return weights + weights_offset ( i ) + j * size ( i-1 );
+    }
 
-        double ** backs = new double*[n_layers-1];
+    const double * row ( int i, int j ) const {
+        return weights + weights_offset ( i ) + j * size ( i-1 );
+    }
 
-        for ( int i {0}; i < n_layers-1; ++i ) {
-            backs[i] = new double [n_units[i+1]];
-        }
+    double weights[weights_offset ( n_layers )];
+    double units[offset ( n_layers )];
+    // as in Perceptron
+    double derivs[offset ( n_layers )];
+    bool derived {false};
+    double backs[offset ( n_layers )];
+    const double *input {nullptr};
+    std::vector<double> batch_units;
+    std::vector<double> batch_derivs;
+    std::vector<double> batch_backs;
 
-        int i {n_layers-1};
+};
 
-        for ( int j {0}; j < n_units[i]; ++j ) {
-            backs[i-1][j] = sigmoid ( units[i][j] ) * ( 1.0-sigmoid ( units[i][j] ) ) * ( y[j] - units[i][j] );
+template <int... Layers>
+constexpr int FixedPerceptron<Layers...>::n_layers;
 
-            for ( int k {0}; k < n_units[i-1]; ++k ) {
-                weights[i-1][j][k] += ( 0.2* backs[i-1][j] *units[i-1][k] );
-            }
+// the perceptrons of the actions of a QL, the small topologies are fixed at
+// compile time, the image sized ones are the runtime Perceptron
+#ifdef PLACE_VALUE
+typedef FixedPerceptron<10*3, 16, 8, 4, 1> ActionPerceptron;
+#elif FOUR_TIMES
+typedef Perceptron ActionPerceptron;
+#elif CHARACTER_CONSOLE
+typedef Perceptron ActionPerceptron;
+#elif LIFEOFGAME
+typedef FixedPerceptron<2, 6, 1> ActionPerceptron;
+#else
+typedef Perceptron ActionPerceptron;
+#endif
 
-        }
+#ifdef FEELINGS
+typedef std::string Feeling;
+#endif
 
-        for ( int i {n_layers-2}; i >0 ; --i ) {
+typedef char SPOTriplet;
 
-            #pragma omp parallel for
-            for ( int j =0; j < n_units[i]; ++j ) {
+// the Q values of all the actions of a QL for one image: the first layers of
+// the action perceptrons are the row blocks of one stacked matrix, which is
+// multiplied by the image in one loop (by one team if it is large enough),
+// then the other layers are computed perceptron by perceptron; the values are
+// kept until the next evaluate, so max and argmax of a step share them
+class ActionBank
+{
+public:
 
-                double sum = 0.0;
+    void evaluate ( const std::map<SPOTriplet, ActionPerceptron*> & prcps, double image[] ) {
+        triplets.clear();
+        perceptrons.clear();
 
-                for ( int l = 0; l < n_units[i+1]; ++l ) {
-                    sum += 0.19*weights[i][l][j]*backs[i][l];
-                }
+        for ( auto & prcp : prcps ) {
+            triplets.push_back ( prcp.first );
+            perceptrons.push_back ( prcp.second );
+        }
 
-                backs[i-1][j] = sigmoid ( units[i][j] ) * ( 1.0-sigmoid ( units[i][j] ) ) * sum;
+        q.resize ( perceptrons.size() );
 
-                for ( int k = 0; k < n_units[i-1]; ++k ) {
-                    weights[i-1][j][k] += ( 0.19* backs[i-1][j] *units[i-1][k] );
-                }
-            }
+        if ( perceptrons.empty() ) {
+            return;
         }
 
-        for ( int i {0}; i < n_layers-1; ++i ) {
-            delete [] backs[i];
+        for ( ActionPerceptron * prcp : perceptrons ) {
+            prcp->first_input ( image );
         }
 
-        delete [] backs;
-
-    }
+        // the actions have the same topology
+        int hidden = perceptrons[0]->first_units();
+        long rows = ( long ) perceptrons.size() * hidden;
 
-    ~Perceptron() {
-        for ( int i {1}; i < n_layers; ++i ) {
-            for ( int j {0}; j < n_units[i]; ++j ) {
-                delete [] weights[i-1][j];
+        if ( SamuThreads::dispatch ( rows, perceptrons[0]->inputs() ) == SamuThreads::PARALLEL ) {
+            #pragma omp parallel for num_threads ( SamuThreads::budget() )
+            for ( long r = 0; r < rows; ++r ) {
+                perceptrons[r / hidden]->first_unit ( image, r % hidden );
+            }
+        } else {
+            for ( long r = 0; r < rows; ++r ) {
+                perceptrons[r / hidden]->first_unit ( image, r % hidden );
             }
-
-            delete [] weights[i-1];
         }
 
-        delete [] weights;
+        for ( std::size_t a {0}; a < perceptrons.size(); ++a ) {
+            q[a] = perceptrons[a]->forward_rest ( image );
+        }
+    }
 
-        for ( int i {0}; i < n_layers; ++i ) {
-            if ( i ) {
-                delete [] units[i];
+    // the perceptron of the action has learned since evaluate
+    void update ( SPOTriplet action, double image[] ) {
+        for ( std::size_t a {0}; a < triplets.size(); ++a ) {
+            if ( triplets[a] == action ) {
+                q[a] = ( *perceptrons[a] ) ( image );
             }
         }
+    }
 
-        delete [] units;
-        delete [] n_units;
+    std::size_t size() const {
+        return triplets.size();
+    }
 
+    SPOTriplet action ( std::size_t a ) const {
+        return triplets[a];
     }
 
-    void save ( std::fstream & out ) {
-        out << " "
-            << n_layers;
+    double value ( std::size_t a ) const {
+        return q[a];
+    }
 
-        for ( int i {0}; i < n_layers; ++i ) {
-            out << " " << n_units[i];
-        }
+private:
+    std::vector<SPOTriplet> triplets;
+    std::vector<ActionPerceptron*> perceptrons;
+    std::vector<double> q;
+};
 
-        for ( int i {1}; i < n_layers; ++i ) {
-            for ( int j {0}; j < n_units[i]; ++j ) {
-                for ( int k {0}; k < n_units[i-1]; ++k ) {
-                    out << " "
-                        << weights[i-1][j][k];
+#ifdef EXPERIENCE_REPLAY
+// the last (prev_image, target) pairs of the actions of a QL: the perceptron
+// of an action is trained by all of its samples at once (learning_batch),
+// the memory is capacity images per action
+class ReplayBuffer
+{
+public:
+    static const int capacity {16};
 
-                }
-            }
+    void push ( SPOTriplet action, const double image[], int inputs, double target ) {
+        Samples & samples = actions[action];
+
+        if ( samples.images.empty() ) {
+            samples.images.resize ( ( long ) capacity * inputs );
+            samples.targets.resize ( capacity );
         }
 
+        std::copy ( image, image + inputs, samples.images.begin() + ( long ) samples.next * inputs );
+        samples.targets[samples.next] = target;
+
+        samples.next = ( samples.next + 1 ) % capacity;
+        if ( samples.size < capacity ) {
+            ++samples.size;
+        }
     }
 
-private:
-    Perceptron ( const Perceptron & );
-    Perceptron & operator= ( const Perceptron & );
+    void replay ( SPOTriplet action, ActionPerceptron & prcp ) {
+        std::map<SPOTriplet, Samples>::iterator it = actions.find ( action );
 
-    int n_layers;
-    int* n_units;
-    double **units;
-    double ***weights;
+        if ( it != actions.end() ) {
+            prcp.learning_batch ( it->second.images.data(), it->second.targets.data(), it->second.size );
+        }
+    }
 
+private:
+    // a ring of the samples, the first size of them are valid
+    struct Samples {
+        std::vector<double> images;
+        std::vector<double> targets;
+        int next {0};
+        int size {0};
+    };
+
+    std::map<SPOTriplet, Samples> actions;
 };
-
-#ifdef FEELINGS
-typedef std::string Feeling;
 #endif
 
-typedef char SPOTriplet;
 typedef std::pair<long long, SPOTriplet> ReinforcedAction;
 
+// entry counts and estimated heap bytes of the tables of a QL
+struct QLMemory {
+    long table {0};
+    long phantom {0};
+    long frqs {0};
+    long rules {0};
+    long bytes {0};
+};
+
 class QL
 {
 public:
@@ -322,7 +1684,7 @@ public:
 
     ~QL() {
 #ifndef Q_LOOKUP_TABLE
-        for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+        for ( std::map<SPOTriplet, ActionPerceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
             delete it->second;
         }
 #endif
@@ -334,7 +1696,7 @@ public:
 
     }
 
-    double f ( double u, int n ) {
+    double f ( double u, int n ) const {
         if ( n < N_e ) {
             return max_reward;
         } else {
@@ -359,13 +1721,24 @@ public:
 
 #ifndef Q_LOOKUP_TABLE
 
-    double max_ap_Q_sp_ap ( double image[] ) {
+    // the arithmetic of the perceptrons of the actions (the present and the
+    // future ones)
+    void setPrecision ( Perceptron::Precision p ) {
+        precision = p;
+
+        for ( std::map<SPOTriplet, ActionPerceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+            it->second->setPrecision ( precision );
+        }
+    }
+
+    // the image must be the one of the last actions.evaluate
+    double max_ap_Q_sp_ap ( double [] ) {
         double q_spap;
         double min_q_spap = -std::numeric_limits<double>::max();
 
-        for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+        for ( std::size_t a {0}; a < actions.size(); ++a ) {
 
-            q_spap = ( * ( it->second ) ) ( image );
+            q_spap = actions.value ( a );
             if ( q_spap > min_q_spap ) {
                 min_q_spap = q_spap;
             }
@@ -397,7 +1770,7 @@ public:
             }
 
         else
-            for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+            for ( std::map<SPOTriplet, ActionPerceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
 
                 q_spap = ( * ( it->second ) ) ( image );
                 if ( q_spap > min_q_spap ) {
@@ -427,7 +1800,7 @@ public:
 #endif
 
 #ifdef LZW_TREE
-    SPOTriplet argmax_ap_f_lzw ( std::string prg, double image[] ) {
+    SPOTriplet argmax_ap_f_lzw ( long long prg, double image[] ) {
         double min_f = -std::numeric_limits<double>::max();
         SPOTriplet ap;
 
@@ -447,7 +1820,7 @@ public:
         if ( rN ) {
             for ( std::map<SPOTriplet, TripletNode*>::iterator it=children.begin(); it!=children.end(); ++it ) {
                 /*
-                    for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it )
+                    for ( std::map<SPOTriplet, ActionPerceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it )
                       {
                 */
                 //double  q_spap = ( * ( it->second ) ) ( image );
@@ -484,7 +1857,7 @@ public:
 #endif
 
         } else {
-            for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+            for ( std::map<SPOTriplet, ActionPerceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
                 double  q_spap = ( * ( it->second ) ) ( image );
                 double explor = f ( q_spap, frqs[it->first][prg] );
 
@@ -520,7 +1893,8 @@ public:
     }
 #endif
 
-    SPOTriplet argmax_ap_f ( std::string prg, double image[] ) {
+    // the image must be the one of the last actions.evaluate
+    SPOTriplet argmax_ap_f ( long long prg, double [] ) {
         double min_f = -std::numeric_limits<double>::max();
         SPOTriplet ap;
 
@@ -529,10 +1903,10 @@ public:
         double a = std::numeric_limits<double>::max(), b = -std::numeric_limits<double>::max();
 #endif
 
-        for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+        for ( std::size_t i {0}; i < actions.size(); ++i ) {
 
-            double  q_spap = ( * ( it->second ) ) ( image );
-            double explor = f ( q_spap, frqs[it->first][prg] );
+            double  q_spap = actions.value ( i );
+            double explor = f ( q_spap, frqs[actions.action ( i )][prg] );
 
 #ifdef QNN_DEBUG_BREL
             sum += q_spap;
@@ -548,7 +1922,7 @@ public:
 
             if ( explor >= min_f ) {
                 min_f = explor;
-                ap = it->first;
+                ap = actions.action ( i );
 #ifdef QNN_DEBUG_BREL
                 rel = q_spap;
 #endif
@@ -562,7 +1936,7 @@ public:
     }
 
 #ifdef FEELINGS
-    Feeling argmax_ap_f_f ( std::string prg, double image[] ) {
+    Feeling argmax_ap_f_f ( long long prg, double image[] ) {
         double min_f = -std::numeric_limits<double>::max();
         Feeling ap;
 
@@ -604,7 +1978,9 @@ public:
     }
 #endif
 
-    SPOTriplet operator() ( SPOTriplet triplet, std::string prg, double image[] ) {
+    SPOTriplet operator() ( SPOTriplet triplet, long long prg, double image[] ) {
+
+        PHASE_TIMER ( QL_STEP );
 
         *this << triplet;
 
@@ -625,7 +2001,7 @@ public:
 
 #ifdef PLACE_VALUE
 //        prcps[triplet] = new Perceptron ( 3, 10*3, 4,  1 ); //exp.a1 // 302
-            prcps[triplet] = new Perceptron ( 5, 10*3, 16, 8, 4,  1 );
+            prcps[triplet] = new ActionPerceptron ();
 
 #elif FOUR_TIMES
             prcps[triplet] = new Perceptron ( 3, 2*10*2*80, 32,  1 );
@@ -641,11 +2017,12 @@ public:
 #elif LIFEOFGAME
             //prcps[triplet] = new Perceptron ( 3, 9, 32, 1 );
 //	    prcps[triplet] = new Perceptron ( 4, 2, 64, 9, 1 );
-            prcps[triplet] = new Perceptron ( 3, 2, 6, 1 );
+            prcps[triplet] = new ActionPerceptron ();
 #else
             prcps[triplet] = new Perceptron ( 3, 256*256, 80, 1 );
             //prcps[triplet] = new Perceptron ( 3, 256*256, 400, 1 );
 #endif
+            prcps[triplet]->setPrecision ( precision );
         }
 
         SPOTriplet action = triplet;
@@ -656,6 +2033,10 @@ public:
             ++frqs_f[prev_feeling][prev_state];
 #endif
 
+#ifndef LZW_TREE
+            actions.evaluate ( prcps, image );
+#endif
+
 #ifndef SARSA
             double max_ap_q_sp_ap = max_ap_Q_sp_ap ( image );
 #else
@@ -665,14 +2046,17 @@ public:
 #ifdef FEELINGS
             double max_ap_q_sp_ap_f = max_ap_Q_sp_ap_f ( image );
 #endif
-            double old_q_q_s_a_nn_q_s_a;
+#ifndef EXPERIENCE_REPLAY
+            double old_q_q_s_a_nn_q_s_a {std::numeric_limits<double>::max() };
 
-            for ( int z {0}; z<10; ++z ) {
-                double nn_q_s_a = ( *prcps[prev_action] ) ( prev_image );
+            // the training steps return the values of the next iteration
+            double nn_q_s_a = ( *prcps[prev_action] ) ( prev_image );
 #ifdef FEELINGS
-                double nn_q_s_a_f = ( *prcps_f[prev_feeling] ) ( prev_image );
+            double nn_q_s_a_f = ( *prcps_f[prev_feeling] ) ( prev_image );
 #endif
 
+            for ( int z {0}; z<10; ++z ) {
+
                 double q_q_s_a = nn_q_s_a +
                                  alpha ( frqs[prev_action][prev_state] ) *
                                  ( reward + gamma * max_ap_q_sp_ap - nn_q_s_a );
@@ -682,10 +2066,10 @@ public:
                                    alpha ( frqs_f[prev_feeling][prev_state] ) *
                                    ( reward + gamma * max_ap_q_sp_ap_f - nn_q_s_a_f );
 #endif
-                prcps[prev_action]->learning ( prev_image, q_q_s_a, nn_q_s_a );
+                double next_nn_q_s_a = prcps[prev_action]->train ( prev_image, q_q_s_a, nn_q_s_a );
 
 #ifdef FEELINGS
-                prcps_f[prev_feeling]->learning ( prev_image, q_q_s_a_f, nn_q_s_a_f );
+                double next_nn_q_s_a_f = prcps_f[prev_feeling]->train ( prev_image, q_q_s_a_f, nn_q_s_a_f );
 #endif
 
 #ifdef NN_DEBUG
@@ -712,14 +2096,40 @@ public:
                 }
 
                 old_q_q_s_a_nn_q_s_a = q_q_s_a - nn_q_s_a;
+                nn_q_s_a = next_nn_q_s_a;
+#ifdef FEELINGS
+                nn_q_s_a_f = next_nn_q_s_a_f;
+#endif
 
             }
+#else
+            // instead of the convergence loop on the last sample: one update of
+            // the perceptron of the previous action by its last samples
+            double nn_q_s_a = ( *prcps[prev_action] ) ( prev_image );
+            double q_q_s_a = nn_q_s_a +
+                             alpha ( frqs[prev_action][prev_state] ) *
+                             ( reward + gamma * max_ap_q_sp_ap - nn_q_s_a );
+
+            replay.push ( prev_action, prev_image, prcps[prev_action]->inputs(), q_q_s_a );
+            replay.replay ( prev_action, *prcps[prev_action] );
+
+#ifdef FEELINGS
+            double nn_q_s_a_f = ( *prcps_f[prev_feeling] ) ( prev_image );
+            double q_q_s_a_f = nn_q_s_a_f +
+                               alpha ( frqs_f[prev_feeling][prev_state] ) *
+                               ( reward + gamma * max_ap_q_sp_ap_f - nn_q_s_a_f );
+
+            prcps_f[prev_feeling]->learning ( prev_image, q_q_s_a_f, nn_q_s_a_f );
+#endif
+#endif
 
 
 //        action = argmax_ap_f ( prg, image );
 #ifdef LZW_TREE
             action = argmax_ap_f_lzw ( prg, image );
 #else
+            // only the perceptron of the previous action has learned since the evaluation
+            actions.update ( prev_action, image );
             action = argmax_ap_f ( prg, image );
 #endif
 
@@ -755,41 +2165,17 @@ public:
 #else
 
     double max_ap_Q_sp_ap ( long long prg ) {
-        double q_spap;
-        double min_q_spap = -std::numeric_limits<double>::max();
-
-        for ( std::map<SPOTriplet, std::map<long long, double>>::iterator it=table_.begin(); it!=table_.end(); ++it ) {
-            q_spap = it->second[prg];
-            if ( q_spap > min_q_spap ) {
-                min_q_spap = q_spap;
-            }
-        }
-
-        return min_q_spap;
+        return best ( prg ).max_q;
     }
 
     SPOTriplet argmax_ap_f ( long long prg ) {
-        double q_spap;
-        double min_f = -std::numeric_limits<double>::max();
-        SPOTriplet ap;
-
-        for ( std::map<SPOTriplet, std::map<long long, double>>::iterator it=table_.begin(); it!=table_.end(); ++it ) {
-
-            q_spap = it->second[prg];
-
-            double explor = f ( q_spap, frqs[it->first][prg] );
-
-            if ( explor > min_f ) {
-                min_f = explor;
-                ap = it->first;
-            }
-        }
-
-        return ap;
+        return best ( prg ).argmax_f;
     }
 
     SPOTriplet operator() ( SPOTriplet triplet, long long prg, bool isLearning ) {
 
+        PHASE_TIMER ( QL_STEP );
+
         // s' = triplet
         // r' = reward
 
@@ -823,15 +2209,17 @@ public:
                 }
 
                 ++frqs[prev_action][prev_state];
+                update_best ( prev_action, prev_state );
 
-                table_[triplet][prg] = table_[triplet][prg];
+                actions ( triplet );
 
                 double max_ap_q_sp_ap = max_ap_Q_sp_ap ( prg );
 
-                table_[prev_action][prev_state] =
-                    table_[prev_action][prev_state] +
-                    alpha ( frqs[prev_action][prev_state] ) *
-                    ( reward + gamma * max_ap_q_sp_ap - table_[prev_action][prev_state] );
+                double & q_s_a = actions ( prev_action ) [prev_state];
+                q_s_a = q_s_a +
+                        alpha ( frqs[prev_action][prev_state] ) *
+                        ( reward + gamma * max_ap_q_sp_ap - q_s_a );
+                update_best ( prev_action, prev_state );
             }
 
             action = argmax_ap_f ( prg );
@@ -874,6 +2262,9 @@ public:
                 itt->second = 0;
             }
         }
+#ifdef Q_LOOKUP_TABLE
+        ++generation;
+#endif
 
     }
 
@@ -905,6 +2296,9 @@ for ( std::map<long long, int>::iterator itt=it->second.begin(); itt!=it->second
 itt->second *= s;
 }
 }
+#ifdef Q_LOOKUP_TABLE
+        ++generation;
+#endif
  
 }
 /*
@@ -912,7 +2306,7 @@ itt->second *= s;
         samuFile << prcps.size();
  
         int prev_p {0};
-        for ( std::map<SPOTriplet, Perceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
+        for ( std::map<SPOTriplet, ActionPerceptron*>::iterator it=prcps.begin(); it!=prcps.end(); ++it ) {
             int p = ( std::distance ( prcps.begin(), it ) * 100 ) / prcps.size();
             if ( p > prev_p+9 ) {
                 std::cerr << "Saving Samu: "
@@ -985,7 +2379,7 @@ itt->second *= s;
  
             file >> t;
  
-            prcps[t] = new Perceptron ( file );
+            prcps[t] = new ActionPerceptron ( file );
         }
  
     }
@@ -1033,6 +2427,9 @@ itt->second *= s;
 
     void set_N_e ( int N_e ) {
         this->N_e = N_e;
+#ifdef Q_LOOKUP_TABLE
+        ++generation;
+#endif
     }
 
     double get_max_reward ( void ) const {
@@ -1073,8 +2470,53 @@ int getNumRules() const {
 return rules.size();
 }
  
- 
+#ifdef Q_LOOKUP_TABLE
+    // phantom entries are the Q values that are still zero (they were inserted by the lookups before the cache of best_)
+    QLMemory memory() const {
+        QLMemory m;
+
+        for ( auto& action : table_ ) {
+            m.table += action.second.size();
+            for ( auto& q : action.second ) {
+                if ( q.second == 0.0 ) {
+                    ++m.phantom;
+                }
+            }
+        }
+        for ( auto& action : frqs ) {
+            m.frqs += action.second.size();
+        }
+        m.rules = rules.size();
+
+        m.bytes = ( table_.size() + frqs.size() ) * node_bytes<std::pair<const SPOTriplet, std::map<long long, double>>>()
+                  + m.table * node_bytes<std::pair<const long long, double>>()
+                  + m.frqs * node_bytes<std::pair<const long long, int>>()
+                  + m.rules * node_bytes<std::pair<const ReinforcedAction, int>>()
+                  + best_.size() * node_bytes<std::pair<const long long, StateBest>>();
+
+        return m;
+    }
+
+    // starts from a copy of the Q values of ql (the QLs of the seed MPU are
+    // evaluated by other tasks at the same time, so they share nothing), the
+    // frequencies and the rules start from zero
+    void seed ( const QL & ql ) {
+        table_ = ql.table_;
+        frqs.clear();
+        rules.clear();
+        best_.clear();
+        seeded = true;
+        ++generation;
+    }
+#endif
+
 private:
+
+    // a red-black tree node of libstdc++ (3 pointers and the color) with the malloc header, rounded up to 16 bytes
+    template<typename T>
+    static long node_bytes() {
+        return ( 32 + sizeof ( T ) + 8 + 15 ) / 16 * 16;
+    }
  
 #ifndef Q_LOOKUP_TABLE //*** This condition only for temporary use in the project SamuVocab (without approx NN)
 class TripletNode
@@ -1113,7 +2555,7 @@ std::map<SPOTriplet, TripletNode*> children;
 };
  
 TripletNode root;
-TripletNode *tree;
+TripletNode *tree {&root};
 int depth {0};
  
 #endif
@@ -1161,9 +2603,137 @@ double gamma = .2;
  
 #ifdef Q_LOOKUP_TABLE
 //std::map<SPOTriplet, std::map<std::string, double>> table_;
-std::map<SPOTriplet, std::map<long long, double>> table_;
+typedef std::map<SPOTriplet, std::map<long long, double>> Table;
+    Table table_;
+
+    // The max of Q and the argmax of the exploration function f of a state.
+    // They are kept up to date by update_best after every change of a Q value
+    // or of a frequency. Only the states that have a Q value or a frequency are
+    // cached, the others are "empty": Q = 0 and f = max_reward for each action.
+    // A new action or a rescaling of the frequencies changes all the states,
+    // these are handled lazily by the generation counter: a stale entry is
+    // rescanned and refreshed by the first lookup of its state.
+    struct StateBest {
+        double max_q;
+        SPOTriplet max_a;
+        double max_f;
+        SPOTriplet argmax_f;
+        unsigned long generation;
+    };
+    mutable std::map<long long, StateBest> best_;
+    unsigned long generation {0};
+    // a seeded QL has Q values of states that are not cached
+    bool seeded {false};
+
+    std::map<long long, double> & actions ( SPOTriplet a ) {
+        Table::iterator it = table_.find ( a );
+
+        if ( it == table_.end() ) {
+            ++generation;
+            it = table_.emplace ( a, std::map<long long, double>() ).first;
+        }
+
+        return it->second;
+    }
+
+    double q ( SPOTriplet a, long long s ) const {
+        const std::map<long long, double> & q_a = table_.at ( a );
+        std::map<long long, double>::const_iterator it = q_a.find ( s );
+        return it != q_a.end() ? it->second : 0.0;
+    }
+
+    int n ( SPOTriplet a, long long s ) const {
+        std::map<SPOTriplet, std::map<long long, int>>::const_iterator it = frqs.find ( a );
+        if ( it == frqs.end() ) {
+            return 0;
+        }
+
+        std::map<long long, int>::const_iterator itt = it->second.find ( s );
+        return itt != it->second.end() ? itt->second : 0;
+    }
+
+    // the same loops as the original max_ap_Q_sp_ap and argmax_ap_f but without inserting
+    StateBest scan ( long long s ) const {
+        StateBest b {-std::numeric_limits<double>::max(), 0, -std::numeric_limits<double>::max(), 0, generation};
+
+        for ( auto& action : table_ ) {
+            std::map<long long, double>::const_iterator it = action.second.find ( s );
+            double q_spap = it != action.second.end() ? it->second : 0.0;
+
+            if ( q_spap > b.max_q ) {
+                b.max_q = q_spap;
+                b.max_a = action.first;
+            }
+
+            double explor = f ( q_spap, n ( action.first, s ) );
+
+            if ( explor > b.max_f ) {
+                b.max_f = explor;
+                b.argmax_f = action.first;
+            }
+        }
+
+        return b;
+    }
+
+    StateBest best ( long long s ) const {
+        std::map<long long, StateBest>::iterator it = best_.find ( s );
+
+        if ( it != best_.end() ) {
+            if ( it->second.generation != generation ) {
+                it->second = scan ( s );
+            }
+            return it->second;
+        } else if ( table_.empty() || seeded ) {
+            return scan ( s );
+        } else {
+            // an empty state, every action is unexplored, the first one wins
+            return StateBest {0.0, table_.begin()->first, f ( 0.0, 0 ), table_.begin()->first, generation};
+        }
+    }
+
+    void update_best ( SPOTriplet a, long long s ) {
+        if ( table_.find ( a ) == table_.end() ) {
+            return;
+        }
+
+        std::map<long long, StateBest>::iterator it = best_.find ( s );
+
+        if ( it == best_.end() || it->second.generation != generation ) {
+            best_[s] = scan ( s );
+            return;
+        }
+
+        StateBest & b = it->second;
+        double q_spap = q ( a, s );
+        double explor = f ( q_spap, n ( a, s ) );
+
+        if ( a == b.max_a && q_spap < b.max_q ) {
+            b = scan ( s );
+            return;
+        } else if ( a == b.max_a || q_spap > b.max_q || ( q_spap == b.max_q && a < b.max_a ) ) {
+            b.max_q = q_spap;
+            b.max_a = a;
+        }
+
+        if ( a == b.argmax_f ) {
+            if ( explor >= b.max_f ) {
+                b.max_f = explor;
+            } else {
+                b = scan ( s );
+            }
+        } else if ( explor > b.max_f || ( explor == b.max_f && a < b.argmax_f ) ) {
+            b.max_f = explor;
+            b.argmax_f = a;
+        }
+    }
 #else
-std::map<SPOTriplet, Perceptron*> prcps;
+std::map<SPOTriplet, ActionPerceptron*> prcps;
+ActionBank actions;
+Perceptron::Precision precision {Perceptron::DOUBLE};
+#ifdef EXPERIENCE_REPLAY
+ReplayBuffer replay;
+#endif
 #ifdef FEELINGS
 std::map<Feeling, Perceptron*> prcps_f;
 #endif
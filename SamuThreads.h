@@ -0,0 +1,98 @@
+#ifndef SamuThreads_H
+#define SamuThreads_H
+
+/**
+ * @brief Thread budget and size-aware dispatch of the kernels
+ *
+ * @file SamuThreads.h
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * The budget is the number of threads of the whole process: the team of
+ * SamuBrain::apred and the teams of the Perceptron layers are sized by it.
+ * It is omp_get_max_threads() by default, or the value of the SAMU_THREADS
+ * environment variable.
+ *
+ * A layer of rows x cols multiply-adds is computed
+ *  - SCALAR if its rows are shorter than one SIMD block,
+ *  - SIMD by the calling thread if it is already in a parallel region (e.g.
+ *    in a task of apred), if the budget is one thread, or if the work is too
+ *    small to pay for waking a team (about a microsecond),
+ *  - PARALLEL by a team of the budget otherwise.
+ */
+
+#include <cstdlib>
+#include <omp.h>
+
+class SamuThreads
+{
+public:
+
+    enum Mode {
+        SCALAR,
+        SIMD,
+        PARALLEL
+    };
+
+    // the multiply-adds of a layer below which one thread is faster than a team
+    static const long parallel_work {1L << 15};
+    // the shortest row that is worth vectorizing
+    static const int simd_cols {8};
+
+    static int budget() {
+        return threads();
+    }
+
+    static void setBudget ( int budget ) {
+        threads() = budget > 0 ? budget : 1;
+    }
+
+    static Mode dispatch ( long rows, long cols ) {
+        if ( cols < simd_cols ) {
+            return SCALAR;
+        } else if ( omp_in_parallel() || threads() < 2 || rows*cols < parallel_work ) {
+            return SIMD;
+        } else {
+            return PARALLEL;
+        }
+    }
+
+private:
+
+    static int & threads() {
+        static int budget = init();
+        return budget;
+    }
+
+    static int init() {
+        if ( const char * threads = std::getenv ( "SAMU_THREADS" ) ) {
+            int budget = std::atoi ( threads );
+            if ( budget > 0 ) {
+                return budget;
+            }
+        }
+
+        return omp_get_max_threads();
+    }
+};
+
+#endif
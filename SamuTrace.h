@@ -0,0 +1,246 @@
+#ifndef SamuTrace_H
+#define SamuTrace_H
+
+/**
+ * @brief Chrome trace timeline export of ticks, search phases and parallel tasks
+ *
+ * @file SamuTrace.h
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * The exporter is compiled in only if CHROME_TRACE is defined (see SamuLife.pro),
+ * otherwise the TRACE_ macros expand to nothing.
+ *
+ * The events are collected in per-thread buffers and written at exit in the
+ * Chrome trace event JSON format to SamuVocab.trace.json (or to the file
+ * named by the SAMU_TRACE environment variable). The file can be opened in
+ * chrome://tracing or in https://ui.perfetto.dev
+ *
+ * The tid of an event is the OpenMP thread number of the worker that ran it,
+ * so the per-MPU tasks of SamuBrain::apred show the load of the team.
+ *
+ * The args of an event are built by ChromeTrace::arg, which escapes the
+ * strings (the names of the MPUs are given by the user).
+ */
+
+#ifdef CHROME_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+class ChromeTrace
+{
+public:
+
+    struct Event {
+        std::string name;
+        std::string args;
+        char ph;
+        int tid;
+        double ts;
+        double dur;
+    };
+
+    static ChromeTrace & instance() {
+        // never destroyed, it is still used by the atexit handler
+        static ChromeTrace * trace = new ChromeTrace;
+        return *trace;
+    }
+
+    double now() const {
+        return std::chrono::duration<double, std::micro> (
+                   std::chrono::steady_clock::now() - start ).count();
+    }
+
+    void complete ( const std::string & name, double ts, double dur, const std::string & args ) {
+        add ( name, 'X', ts, dur, args );
+    }
+
+    void instant ( const std::string & name, const std::string & args ) {
+        add ( name, 'i', now(), 0.0, args );
+    }
+
+    // a "key":"value" argument of an event
+    static std::string arg ( const std::string & key, const std::string & value ) {
+        return "\"" + escape ( key ) + "\":\"" + escape ( value ) + "\"";
+    }
+
+    static std::string arg ( const std::string & key, long long value ) {
+        return "\"" + escape ( key ) + "\":" + std::to_string ( value );
+    }
+
+    static std::string escape ( const std::string & str ) {
+        std::string escaped;
+
+        for ( unsigned char c : str ) {
+            if ( c == '"' || c == '\\' ) {
+                escaped += '\\';
+                escaped += c;
+            } else if ( c < 0x20 ) {
+                const char * hex = "0123456789abcdef";
+                escaped += "\\u00";
+                escaped += hex[c >> 4];
+                escaped += hex[c & 0xf];
+            } else {
+                escaped += c;
+            }
+        }
+
+        return escaped;
+    }
+
+    // the threads may still be running (for example the thread of GameOfLife
+    // at exit), so every buffer is locked while it is written
+    void write() {
+        std::lock_guard<std::mutex> lock ( mutex );
+
+        const char * fname = std::getenv ( "SAMU_TRACE" );
+        std::ofstream out ( fname ? fname : "SamuVocab.trace.json" );
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        bool first {true};
+        for ( auto buffer : buffers ) {
+            std::lock_guard<std::mutex> lock ( buffer->mutex );
+
+            for ( auto& e : buffer->events ) {
+                if ( !first ) {
+                    out << ",";
+                }
+                first = false;
+
+                out << "\n{\"name\":\"" << escape ( e.name )
+                    << "\",\"cat\":\"samu\",\"ph\":\"" << e.ph
+                    << "\",\"pid\":1,\"tid\":" << e.tid
+                    << ",\"ts\":" << std::fixed << e.ts;
+                if ( e.ph == 'X' ) {
+                    out << ",\"dur\":" << e.dur;
+                } else {
+                    out << ",\"s\":\"t\"";
+                }
+                if ( !e.args.empty() ) {
+                    out << ",\"args\":{" << e.args << "}";
+                }
+                out << "}";
+            }
+        }
+
+        out << "\n]}\n";
+    }
+
+private:
+
+    // at most this many events are kept, the rest of the run is not traced
+    static const long max_events {4000000};
+
+    ChromeTrace() : start ( std::chrono::steady_clock::now() ) {
+        std::atexit ( onExit );
+    }
+
+    ChromeTrace ( const ChromeTrace & );
+    ChromeTrace & operator= ( const ChromeTrace & );
+
+    static void onExit() {
+        instance().write();
+    }
+
+    struct Buffer {
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    // only the thread of the buffer and write lock it
+    Buffer & buffer() {
+        thread_local Buffer * local {nullptr};
+
+        if ( !local ) {
+            local = new Buffer;
+            std::lock_guard<std::mutex> lock ( mutex );
+            buffers.push_back ( local );
+        }
+
+        return *local;
+    }
+
+    void add ( const std::string & name, char ph, double ts, double dur, const std::string & args ) {
+        if ( nofEvents.fetch_add ( 1, std::memory_order_relaxed ) >= max_events ) {
+            return;
+        }
+
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+#else
+        int tid = 0;
+#endif
+        Buffer & local = buffer();
+        std::lock_guard<std::mutex> lock ( local.mutex );
+        local.events.push_back ( Event {name, args, ph, tid, ts, dur} );
+    }
+
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    std::vector<Buffer*> buffers;
+    std::atomic<long> nofEvents {0};
+};
+
+class TraceScope
+{
+public:
+
+    TraceScope ( const std::string & name, const std::string & args = "" ) :
+        name ( name ), args ( args ), ts ( ChromeTrace::instance().now() ) {
+    }
+
+    ~TraceScope() {
+        ChromeTrace & trace = ChromeTrace::instance();
+        trace.complete ( name, ts, trace.now() - ts, args );
+    }
+
+private:
+
+    TraceScope ( const TraceScope & );
+    TraceScope & operator= ( const TraceScope & );
+
+    std::string name;
+    std::string args;
+    double ts;
+};
+
+#define TRACE_SCOPE(...) TraceScope trace_scope ( __VA_ARGS__ )
+#define TRACE_INSTANT(...) ChromeTrace::instance().instant ( __VA_ARGS__ )
+
+#else
+
+#define TRACE_SCOPE(...)
+#define TRACE_INSTANT(...)
+
+#endif
+
+#endif
@@ -0,0 +1,376 @@
+/**
+ * @brief Micro-benchmarks of the hot paths of SamuVocab
+ *
+ * @file SamuBench.cpp
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Every benchmark is repeated 5 times with fixed seeds and the median
+ * time per operation is written as a CSV line, so the results of two
+ * commits can be compared with a simple diff or join:
+ *
+ * cd bench/
+ * ~/Qt/5.5/gcc_64/bin/qmake SamuBench.pro
+ * make
+ * ./SamuBench bench.csv
+ */
+
+#include "SamuBrain.h"
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+
+class Bench
+{
+  std::ostream & out;
+
+  static const int repetitions {5};
+
+public:
+
+  Bench ( std::ostream & out ) : out ( out )
+  {
+    out << "benchmark,param,iterations,ns_per_op" << std::endl;
+  }
+
+  template<typename F>
+  void run ( const std::string & name, const std::string & param, long iterations, F f )
+  {
+    std::vector<double> times;
+
+    for ( int rep {0}; rep<repetitions; ++rep )
+      {
+        auto start = std::chrono::steady_clock::now();
+
+        for ( long i {0}; i<iterations; ++i )
+          {
+            f ( i );
+          }
+
+        times.push_back ( std::chrono::duration<double, std::nano> (
+                            std::chrono::steady_clock::now() - start ).count() / iterations );
+      }
+
+    std::sort ( times.begin(), times.end() );
+
+    out << name << ","
+        << param << ","
+        << iterations << ","
+        << times[repetitions/2]
+        << std::endl;
+  }
+
+};
+
+volatile long long sink;
+
+std::vector<long long> states ( int n, std::mt19937 & gen )
+{
+  std::uniform_int_distribution<long long> dist ( 1, std::numeric_limits<long long>::max() );
+  std::vector<long long> keys ( n );
+
+  for ( auto& key : keys )
+    {
+      key = dist ( gen );
+    }
+
+  return keys;
+}
+
+std::vector<SPOTriplet> triplets ( int n, std::mt19937 & gen )
+{
+  // the letters of the ticker and the empty cell
+  std::uniform_int_distribution<int> dist ( 'a'-1, 'z' );
+  std::vector<SPOTriplet> letters ( n );
+
+  for ( auto& letter : letters )
+    {
+      int l = dist ( gen );
+      letter = ( l < 'a' ) ? 0 : l;
+    }
+
+  return letters;
+}
+
+// lets the QL visit every state more than N_e times in learning mode
+void fill ( QL & ql, const std::vector<long long> & keys, const std::vector<SPOTriplet> & letters )
+{
+  for ( int pass {0}; pass<ql.get_N_e() +2; ++pass )
+    for ( std::size_t i {0}; i<keys.size(); ++i )
+      {
+        ql ( letters[i], keys[i], true );
+      }
+}
+
+void bench_ql ( Bench & bench )
+{
+  for ( int n : {10, 100, 1000, 10000} )
+    {
+      std::mt19937 gen {42};
+      std::vector<long long> keys = states ( n, gen );
+      std::vector<SPOTriplet> letters = triplets ( n, gen );
+      std::string param = std::to_string ( n );
+
+      QL *ql = new QL;
+      fill ( *ql, keys, letters );
+
+      bench.run ( "QL::operator() learning", param, 20000, [&] ( long i )
+      {
+        sink = ( *ql ) ( letters[i % n], keys[i % n], true );
+      } );
+
+      bench.run ( "QL::operator() query", param, 20000, [&] ( long i )
+      {
+        sink = ( *ql ) ( letters[i % n], keys[i % n], false );
+      } );
+
+      bench.run ( "QL::max_ap_Q_sp_ap", param, 20000, [&] ( long i )
+      {
+        sink = ql->max_ap_Q_sp_ap ( keys[i % n] );
+      } );
+
+      bench.run ( "QL::argmax_ap_f", param, 20000, [&] ( long i )
+      {
+        sink = ql->argmax_ap_f ( keys[i % n] );
+      } );
+
+      delete ql;
+    }
+}
+
+void bench_context_key ( Bench & bench )
+{
+  for ( int w : {34, 80} )
+    {
+      SamuBrain samuBrain ( w, 1 );
+
+      Lattice reality ( w, 1 );
+
+      std::mt19937 gen {42};
+      std::vector<SPOTriplet> letters = triplets ( w, gen );
+      std::copy ( letters.begin(), letters.end(), reality[0] );
+
+      bench.run ( "SamuBrain::context_key", std::to_string ( w ), 1000000, [&] ( long i )
+      {
+        sink = samuBrain.context_key ( 0, i % w, reality.view() );
+      } );
+    }
+}
+
+void bench_habituation ( Bench & bench )
+{
+  HabituationBank habituations;
+  Habituation habi ( habituations, nullptr );
+  double mon;
+
+  // converging, then a new input that breaks the convergence
+  bench.run ( "Habituation::is_habituation", "converging", 1000000, [&] ( long i )
+  {
+    int vsum = ( i % 1000 < 900 ) ? 12 : 3;
+    sink = habi.is_habituation ( vsum, vsum, mon );
+  } );
+
+  bench.run ( "Habituation::is_habituation", "noisy", 1000000, [&] ( long i )
+  {
+    sink = habi.is_habituation ( 12, i % 13, mon );
+  } );
+
+  for ( int n : {10, 100, 1000, 10000} )
+    {
+      HabituationBank bank;
+      for ( int s {0}; s<n; ++s )
+        {
+          bank.acquire ( nullptr );
+        }
+
+      bench.run ( "HabituationBank::update", std::to_string ( n ), 10000, [&] ( long i )
+      {
+        for ( int s {0}; s<n; ++s )
+          {
+            int vsum = ( ( ( i+s ) & 1023 ) < 900 ) ? 12 : 3;
+            bank.input ( s, vsum, vsum );
+          }
+        sink = bank.update().size();
+      } );
+    }
+}
+
+void bench_mpu ( Bench & bench )
+{
+  HabituationBank habituations;
+
+  for ( auto size : { std::make_pair ( 34, 1 ), std::make_pair ( 40, 30 ) } )
+    {
+      std::string param = std::to_string ( size.first ) + "x" + std::to_string ( size.second );
+
+      bench.run ( "MentalProcessingUnit()", param, 1000, [&] ( long )
+      {
+        MentalProcessingUnit *mpu = new MentalProcessingUnit ( habituations, size.first, size.second );
+        sink = ( long long ) mpu;
+        delete mpu;
+      } );
+
+      MentalProcessingUnit mpu ( habituations, size.first, size.second );
+
+      bench.run ( "MentalProcessingUnit::cls", param, 100000, [&] ( long )
+      {
+        mpu.cls();
+      } );
+
+      std::mt19937 gen {42};
+      std::vector<SPOTriplet> letters = triplets ( size.first, gen );
+
+      bench.run ( "MentalProcessingUnit::compare", param, 1000000, [&] ( long i )
+      {
+        mpu.compare ( i % size.second, letters.data() );
+      } );
+      sink = mpu.sum;
+    }
+}
+
+void bench_perceptron ( Bench & bench )
+{
+  std::mt19937 gen {42};
+  std::uniform_real_distribution<double> dist ( 0.0, 1.0 );
+
+  // dense random images, or with one_hot the frames of a word of 8
+  // characters in the 10*80 one-hot images of CHARACTER_CONSOLE
+  auto fill = [&] ( double * image, int inputs, bool one_hot )
+  {
+    if ( one_hot )
+      {
+        std::fill ( image, image + inputs, 0.0 );
+
+        int first = gen() % ( inputs / 10 - 8 );
+        for ( int c {first}; c < first + 8; ++c )
+          {
+            image[c*10 + gen() % 10] = 1.0;
+          }
+      }
+    else
+      {
+        for ( int k {0}; k < inputs; ++k )
+          {
+            image[k] = dist ( gen );
+          }
+      }
+  };
+
+  auto run = [&] ( const std::string & name, const std::string & param, auto & prcp, int inputs, long iterations,
+                   bool one_hot )
+  {
+    std::vector<double> image ( inputs );
+
+    fill ( image.data(), inputs, one_hot );
+
+    bench.run ( name + "::operator()", param, iterations, [&] ( long )
+    {
+      sink = ( long long ) ( prcp ( image.data() ) * 1e6 );
+    } );
+
+    // the const forward pass by a workspace of the caller
+    typename std::decay<decltype ( prcp )>::type::Workspace workspace;
+    bench.run ( name + "::operator() const", param, iterations, [&] ( long )
+    {
+      sink = ( long long ) ( prcp ( image.data(), workspace ) * 1e6 );
+    } );
+
+    // a forward pass and a training step as in QL::operator()
+    bench.run ( name + "::learning", param, iterations, [&] ( long )
+    {
+      double q = prcp ( image.data() );
+      prcp.learning ( image.data(), .5*q, q );
+    } );
+
+    // the same iteration with the fused training step
+    double q = prcp ( image.data() );
+    bench.run ( name + "::train", param, iterations, [&] ( long )
+    {
+      q = prcp.train ( image.data(), .5*q, q );
+    } );
+
+    // a mini-batch of 16 samples (an operation is a batch)
+    const int batch {16};
+    std::vector<double> images ( ( long ) batch * inputs );
+    std::vector<double> targets ( batch );
+
+    for ( int s {0}; s < batch; ++s )
+      {
+        fill ( images.data() + ( long ) s * inputs, inputs, one_hot );
+      }
+    for ( auto& y : targets )
+      {
+        y = dist ( gen );
+      }
+
+    bench.run ( name + "::learning_batch", param + "x16", iterations / batch, [&] ( long )
+    {
+      prcp.learning_batch ( images.data(), targets.data(), batch );
+    } );
+  };
+
+  // the topologies of LIFEOFGAME, PLACE_VALUE, CHARACTER_CONSOLE and FOUR_TIMES
+  Perceptron lifeofgame ( 3, 2, 6, 1 );
+  run ( "Perceptron", "2-6-1", lifeofgame, 2, 1000000, false );
+
+  Perceptron placeValue ( 5, 10*3, 16, 8, 4, 1 );
+  run ( "Perceptron", "30-16-8-4-1", placeValue, 10*3, 100000, false );
+
+  Perceptron characterConsole ( 3, 10*80, 32, 1 );
+  run ( "Perceptron", "800-32-1", characterConsole, 10*80, 10000, false );
+  run ( "Perceptron", "800-32-1 one-hot", characterConsole, 10*80, 10000, true );
+
+  Perceptron fourTimes ( 3, 2*10*2*80, 32, 1 );
+  run ( "Perceptron", "3200-32-1", fourTimes, 2*10*2*80, 10000, false );
+  run ( "Perceptron", "3200-32-1 one-hot", fourTimes, 2*10*2*80, 10000, true );
+
+  // the same networks with their topologies fixed at compile time
+  FixedPerceptron<2, 6, 1> fixedLifeofgame;
+  run ( "FixedPerceptron", "2-6-1", fixedLifeofgame, 2, 1000000, false );
+
+  FixedPerceptron<10*3, 16, 8, 4, 1> fixedPlaceValue;
+  run ( "FixedPerceptron", "30-16-8-4-1", fixedPlaceValue, 10*3, 100000, false );
+
+  std::unique_ptr<FixedPerceptron<10*80, 32, 1>> fixedCharacterConsole ( new FixedPerceptron<10*80, 32, 1> );
+  run ( "FixedPerceptron", "800-32-1", *fixedCharacterConsole, 10*80, 10000, false );
+  run ( "FixedPerceptron", "800-32-1 one-hot", *fixedCharacterConsole, 10*80, 10000, true );
+}
+
+int main ( int argc, char** argv )
+{
+  std::ofstream file;
+
+  if ( argc > 1 )
+    {
+      file.open ( argv[1] );
+    }
+
+  Bench bench ( argc > 1 ? file : std::cout );
+
+  bench_ql ( bench );
+  bench_context_key ( bench );
+  bench_habituation ( bench );
+  bench_mpu ( bench );
+  bench_perceptron ( bench );
+
+  return 0;
+}
@@ -0,0 +1,23 @@
+######################################################################
+# Micro-benchmarks of the hot paths of SamuVocab
+######################################################################
+
+DEFINES += LIFEOFGAME
+DEFINES += Q_LOOKUP_TABLE
+DEFINES += RND_DEBUG
+DEFINES += QT_NO_DEBUG_OUTPUT
+
+QT += core
+QT -= gui
+CONFIG += c++14 console
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
+TEMPLATE = app
+TARGET = SamuBench
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../SamuBrain.h ../SamuQl.h ../SamuProf.h ../SamuTrace.h ../SamuLattice.h ../SamuThreads.h
+SOURCES += SamuBench.cpp ../SamuBrain.cpp
@@ -0,0 +1,310 @@
+/**
+ * @brief Accuracy and speed of the reduced-precision perceptrons
+ *
+ * @file SamuPrecisionBench.cpp
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * The frames of the ticker showing the first 20 words of Rebecca Sitton's
+ * list are recorded as one-hot images of 10*80 inputs (as in the
+ * CHARACTER_CONSOLE version). The perceptrons of 5 actions (800-32-1) are
+ * trained by them in double, then copies of the trained networks are
+ * evaluated in FLOAT and INT8 and compared with the double reference on all
+ * the frames: the largest and the mean absolute error of the Q values and
+ * the ratio of the frames where the best action is the same. The "float32
+ * trained" line is a copy of the untrained networks trained in FLOAT by
+ * the same frames. The forward_ns column is the time of an evaluation of
+ * the 5 networks, the next lines are the times of a 256*256-80-1 network.
+ *
+ * The "workspace" lines check the const operator(): one Workspace is reused
+ * by networks of different shapes (wide after deep and so on) in each
+ * precision, the max_abs_error column is the largest difference from the
+ * member operator(), it must be 0 (the exit status is 1 otherwise).
+ *
+ * cd bench/
+ * ~/Qt/5.5/gcc_64/bin/qmake SamuPrecisionBench.pro
+ * make
+ * ./SamuPrecisionBench precision.csv
+ */
+
+#include "SamuQl.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+const int nof_actions {5};
+const int columns {80};
+
+std::vector<std::string> words =
+{
+  "the", "of", "and", "a", "to", "in", "is", "you", "that", "it",
+  "he", "was", "for", "on", "are", "as", "with", "his", "they", "I"
+};
+
+// the frames of the ticker of SamuVocab as one-hot images
+std::vector<std::vector<double>> record ( std::vector<int> & labels )
+{
+  std::vector<std::vector<double>> frames;
+
+  for ( std::size_t w {0}; w < words.size(); ++w )
+    {
+      const std::string & word = words[w];
+      int l = word.length();
+
+      for ( int xx {columns}; xx >= -l; --xx )
+        {
+          std::vector<double> image ( 10*columns, 0.0 );
+
+          for ( int i {0}; i<l; ++i )
+            {
+              if ( xx+i >= 0 && xx+i < columns )
+                {
+                  image[ ( xx+i ) *10 + word[i] % 10] = 1.0;
+                }
+            }
+
+          frames.push_back ( image );
+          labels.push_back ( w % nof_actions );
+        }
+    }
+
+  return frames;
+}
+
+std::unique_ptr<Perceptron> copy ( Perceptron & prcp )
+{
+  std::fstream file ( "SamuPrecisionBench.tmp", std::ios::in | std::ios::out | std::ios::trunc );
+
+  // all the digits, so the copy is the same network
+  file.precision ( 17 );
+  prcp.save ( file );
+  file.seekg ( 0 );
+
+  return std::unique_ptr<Perceptron> ( new Perceptron ( file ) );
+}
+
+typedef std::vector<std::unique_ptr<Perceptron>> Actions;
+
+void train ( Actions & actions, std::vector<std::vector<double>> & frames, std::vector<int> & labels )
+{
+  for ( int epoch {0}; epoch < 3; ++epoch )
+    {
+      for ( std::size_t f {0}; f < frames.size(); ++f )
+        {
+          for ( int a {0}; a < nof_actions; ++a )
+            {
+              Perceptron & prcp = *actions[a];
+
+              prcp ( frames[f].data() );
+              prcp.learning ( frames[f].data(), a == labels[f] ? 1.0 : 0.0, 0.0 );
+            }
+        }
+    }
+}
+
+std::vector<double> evaluate ( Actions & actions, std::vector<std::vector<double>> & frames, double & ns )
+{
+  std::vector<double> q;
+
+  ns = std::numeric_limits<double>::max();
+  for ( int r {0}; r < 5; ++r )
+    {
+      q.clear();
+
+      auto start = std::chrono::steady_clock::now();
+      for ( auto & frame : frames )
+        {
+          for ( auto & prcp : actions )
+            {
+              q.push_back ( ( *prcp ) ( frame.data() ) );
+            }
+        }
+      ns = std::min ( ns, std::chrono::duration<double, std::nano> ( std::chrono::steady_clock::now() - start ).count() / frames.size() );
+    }
+
+  return q;
+}
+
+void compare ( std::ostream & out, const std::string & precision, const std::vector<double> & reference,
+               const std::vector<double> & q, double ns )
+{
+  double max {0.0}, sum {0.0};
+  long same {0};
+
+  for ( std::size_t i {0}; i < q.size(); ++i )
+    {
+      max = std::max ( max, std::fabs ( q[i] - reference[i] ) );
+      sum += std::fabs ( q[i] - reference[i] );
+    }
+
+  for ( std::size_t f {0}; f < q.size(); f += nof_actions )
+    {
+      auto best = std::max_element ( q.begin() + f, q.begin() + f + nof_actions ) - q.begin();
+      auto reference_best = std::max_element ( reference.begin() + f, reference.begin() + f + nof_actions ) - reference.begin();
+
+      same += best == reference_best;
+    }
+
+  out << precision << ",800-32-1,"
+      << max << ","
+      << sum / q.size() << ","
+      << ( double ) same / ( q.size() / nof_actions ) << ","
+      << ns
+      << std::endl;
+}
+
+// the time of a forward pass of the default (256*256 inputs) network
+void image_network ( std::ostream & out )
+{
+  std::vector<double> image ( 256*256 );
+  std::mt19937 gen {42};
+  std::uniform_real_distribution<double> dist ( 0.0, 1.0 );
+
+  for ( auto & x : image )
+    {
+      x = dist ( gen );
+    }
+
+  Perceptron prcp ( 3, 256*256, 80, 1 );
+
+  for ( Perceptron::Precision precision : {Perceptron::DOUBLE, Perceptron::FLOAT, Perceptron::INT8} )
+    {
+      prcp.setPrecision ( precision );
+
+      double best {std::numeric_limits<double>::max() };
+      for ( int r {0}; r < 5; ++r )
+        {
+          auto start = std::chrono::steady_clock::now();
+          prcp ( image.data() );
+          best = std::min ( best, std::chrono::duration<double, std::nano> ( std::chrono::steady_clock::now() - start ).count() );
+        }
+
+      out << ( precision == Perceptron::DOUBLE ? "double" : precision == Perceptron::FLOAT ? "float32" : "int8" )
+          << ",65536-80-1,,,,"
+          << best
+          << std::endl;
+    }
+}
+
+// one workspace of the const operator() shared by networks of different shapes
+bool shared_workspace ( std::ostream & out, std::vector<double> & frame )
+{
+  std::vector<double> image ( 3200 );
+  std::mt19937 gen {42};
+  std::uniform_real_distribution<double> dist ( 0.0, 1.0 );
+
+  for ( auto & x : image )
+    {
+      x = dist ( gen );
+    }
+
+  std::vector<std::pair<std::string, std::unique_ptr<Perceptron>>> networks;
+  networks.emplace_back ( "800-32-1", std::unique_ptr<Perceptron> ( new Perceptron ( 3, 800, 32, 1 ) ) );
+  networks.emplace_back ( "3200-4-1", std::unique_ptr<Perceptron> ( new Perceptron ( 3, 3200, 4, 1 ) ) );
+  networks.emplace_back ( "30-16-8-4-1", std::unique_ptr<Perceptron> ( new Perceptron ( 5, 30, 16, 8, 4, 1 ) ) );
+  networks.emplace_back ( "2-6-1", std::unique_ptr<Perceptron> ( new Perceptron ( 3, 2, 6, 1 ) ) );
+
+  bool same {true};
+
+  for ( Perceptron::Precision precision : {Perceptron::DOUBLE, Perceptron::FLOAT, Perceptron::INT8} )
+    {
+      Perceptron::Workspace workspace;
+
+      for ( auto & network : networks )
+        {
+          Perceptron & prcp = *network.second;
+          prcp.setPrecision ( precision );
+
+          // the one-hot frame for the sparse first layer, the dense image for the others
+          std::vector<double> & x = prcp.inputs() == ( int ) frame.size() ? frame : image;
+          double q = prcp ( x.data(), workspace );
+          double diff = std::fabs ( q - prcp ( x.data() ) );
+
+          same = same && diff == 0.0;
+
+          out << ( precision == Perceptron::DOUBLE ? "double" : precision == Perceptron::FLOAT ? "float32" : "int8" )
+              << " workspace," << network.first << ","
+              << diff << ",,,"
+              << std::endl;
+        }
+    }
+
+  return same;
+}
+
+int main ( int argc, char** argv )
+{
+  std::ofstream file;
+  if ( argc > 1 )
+    {
+      file.open ( argv[1] );
+    }
+  std::ostream & out = argc > 1 ? file : std::cout;
+
+  std::vector<int> labels;
+  std::vector<std::vector<double>> frames = record ( labels );
+
+  Actions reference, untrained;
+  for ( int a {0}; a < nof_actions; ++a )
+    {
+      reference.emplace_back ( new Perceptron ( 3, 10*columns, 32, 1 ) );
+      untrained.push_back ( copy ( *reference.back() ) );
+    }
+
+  train ( reference, frames, labels );
+
+  out << "precision,network,max_abs_error,mean_abs_error,argmax_agreement,forward_ns" << std::endl;
+
+  double ns;
+  std::vector<double> q = evaluate ( reference, frames, ns );
+  compare ( out, "double", q, q, ns );
+
+  for ( Perceptron::Precision precision : {Perceptron::FLOAT, Perceptron::INT8} )
+    {
+      Actions actions;
+      for ( auto & prcp : reference )
+        {
+          actions.push_back ( copy ( *prcp ) );
+          actions.back()->setPrecision ( precision );
+        }
+
+      std::vector<double> reduced = evaluate ( actions, frames, ns );
+      compare ( out, precision == Perceptron::FLOAT ? "float32" : "int8", q, reduced, ns );
+    }
+
+  for ( auto & prcp : untrained )
+    {
+      prcp->setPrecision ( Perceptron::FLOAT );
+    }
+  train ( untrained, frames, labels );
+  std::vector<double> trained = evaluate ( untrained, frames, ns );
+  compare ( out, "float32 trained", q, trained, ns );
+
+  image_network ( out );
+
+  bool same = shared_workspace ( out, frames[frames.size() / 2] );
+
+  std::remove ( "SamuPrecisionBench.tmp" );
+
+  return same ? 0 : 1;
+}
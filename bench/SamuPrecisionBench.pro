@@ -0,0 +1,22 @@
+######################################################################
+# Accuracy and speed of the reduced-precision perceptrons
+######################################################################
+
+DEFINES += CHARACTER_CONSOLE
+DEFINES += RND_DEBUG
+DEFINES += QT_NO_DEBUG_OUTPUT
+
+QT += core
+QT -= gui
+CONFIG += c++14 console
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
+TEMPLATE = app
+TARGET = SamuPrecisionBench
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../SamuQl.h ../SamuProf.h ../SamuThreads.h
+SOURCES += SamuPrecisionBench.cpp
@@ -0,0 +1,260 @@
+/**
+ * @brief Search-scaling benchmark: recognition cost versus number of learned MPUs
+ *
+ * @file SamuSearchBench.cpp
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * A brain is populated with 10, 100, 1000 and 5000 MPUs, each of them
+ * imprinted with a synthetic word (fixed seed) shown by the ticker of
+ * SamuVocab. Then for every thread count a known word is presented, and
+ * after that an unknown one, and the ticks and the wall-clock time are
+ * measured until the searching branch of SamuBrain::learning decides.
+ * One CSV line is written per brain size, thread count and case; strong
+ * scaling can be read along the thread counts of one brain size, weak
+ * scaling along the lines with the same MPUs per thread.
+ *
+ * Every unknown word adds a new MPU, so the later thread counts of a brain
+ * size search among a few more MPUs than the first one.
+ *
+ * The optional fourth argument selects the search strategy (exhaustive or
+ * racing), the mpu_ticks column is the number of MPU evaluations of the
+ * search, exhaustive_mpu_ticks is that of the exhaustive scan of the same ticks.
+ *
+ * cd bench/
+ * ~/Qt/5.5/gcc_64/bin/qmake SamuSearchBench.pro
+ * make
+ * ./SamuSearchBench search.csv 10,100,1000,5000 1,2,4,8
+ * ./SamuSearchBench racing.csv 10,100,1000,5000 1,2,4,8 racing
+ */
+
+#include "SamuBrain.h"
+#include <chrono>
+#include <fstream>
+#include <omp.h>
+
+class Ticker
+{
+  int m_w;
+  int xx;
+  Lattice row;
+  Lattice prediction;
+
+public:
+
+  Ticker ( int w ) : m_w ( w ), xx ( w ), row ( w, 1 ), prediction ( w, 1 )
+  {
+  }
+
+  // the same scrolling as GameOfLife::ticker
+  void show ( SamuBrain & samuBrain, const std::string & word )
+  {
+    int l = word.length();
+
+    row.clear();
+
+    for ( int i {0}; i<l; ++i )
+      {
+        if ( xx+i >= 0 && xx+i < m_w )
+          {
+            row[0][xx+i] = word[i];
+          }
+      }
+
+    if ( --xx < -l )
+      {
+        xx = m_w;
+      }
+
+    LatticeView fp, fr;
+    samuBrain.learning ( row.view(), prediction.view(), fp, fr );
+  }
+
+  void restart()
+  {
+    xx = m_w;
+  }
+};
+
+std::vector<int> parse ( const char * list )
+{
+  std::vector<int> values;
+  std::stringstream ss ( list );
+  std::string value;
+
+  while ( std::getline ( ss, value, ',' ) )
+    {
+      values.push_back ( std::atoi ( value.c_str() ) );
+    }
+
+  return values;
+}
+
+std::string synthetic ( std::mt19937 & gen )
+{
+  std::uniform_int_distribution<int> length ( 2, 8 );
+  std::uniform_int_distribution<int> letter ( 'a', 'z' );
+
+  std::string word;
+  for ( int i = length ( gen ); i>0; --i )
+    {
+      word += ( char ) letter ( gen );
+    }
+
+  return word;
+}
+
+// presents the word until the agent has learnt it (i.e. habituation)
+long settle ( SamuBrain & samuBrain, Ticker & ticker, const std::string & word )
+{
+  long ticks {0};
+
+  ticker.restart();
+  do
+    {
+      ticker.show ( samuBrain, word );
+      ++ticks;
+    }
+  while ( !samuBrain.isLearned() && ticks < 100000 );
+
+  return ticks;
+}
+
+// presents the word until the search started by the new input decides
+long search ( SamuBrain & samuBrain, Ticker & ticker, const std::string & word,
+             long & searchTicks, std::string & decision )
+{
+  long ticks {0};
+  bool searching {false};
+
+  searchTicks = 0;
+
+  ticker.restart();
+  while ( ticks < 100000 )
+    {
+      ticker.show ( samuBrain, word );
+      ++ticks;
+
+      if ( samuBrain.isSearching() )
+        {
+          searching = true;
+          ++searchTicks;
+        }
+      else if ( searching )
+        {
+          break;
+        }
+    }
+
+  decision = samuBrain.get_foobar();
+  return ticks;
+}
+
+int main ( int argc, char** argv )
+{
+  const int w {34};
+
+  std::ofstream file;
+  if ( argc > 1 )
+    {
+      file.open ( argv[1] );
+    }
+  std::ostream & out = argc > 1 ? file : std::cout;
+
+  std::vector<int> sizes = parse ( argc > 2 ? argv[2] : "10,100,1000,5000" );
+  std::vector<int> threads = parse ( argc > 3 ? argv[3] : std::to_string ( omp_get_max_threads() ).c_str() );
+
+  SamuBrain::SearchStrategy strategy = argc > 4 && std::string ( argv[4] ) == "racing" ?
+                                       SamuBrain::RACING : SamuBrain::EXHAUSTIVE;
+
+  out << "mpus,threads,mpus_per_thread,case,ticks,search_ticks,seconds,correct,mpu_ticks,exhaustive_mpu_ticks" << std::endl;
+
+  for ( int size : sizes )
+    {
+      std::mt19937 gen {42};
+      SamuBrain samuBrain ( w, 1 );
+      samuBrain.setSearchStrategy ( strategy );
+      Ticker ticker ( w );
+
+      std::vector<std::string> words;
+      std::vector<std::string> mpus;
+
+      auto start = std::chrono::steady_clock::now();
+      for ( int i {0}; i<size; ++i )
+        {
+          words.push_back ( synthetic ( gen ) );
+
+          if ( i )
+            {
+              samuBrain.imprint();
+            }
+          settle ( samuBrain, ticker, words.back() );
+          mpus.push_back ( samuBrain.get_foobar() );
+        }
+
+      std::cerr << size << " MPUs populated in "
+                << std::chrono::duration<double> ( std::chrono::steady_clock::now() - start ).count()
+                << " s" << std::endl;
+
+      for ( int t : threads )
+        {
+          omp_set_num_threads ( t );
+
+          for ( int known {1}; known>=0; --known )
+            {
+              std::string word = known ? words[size/2] : synthetic ( gen );
+              std::string decision;
+              long searchTicks;
+              long work = samuBrain.getSearchWork();
+              long exhaustiveWork = samuBrain.getExhaustiveWork();
+
+              auto start = std::chrono::steady_clock::now();
+              long ticks = search ( samuBrain, ticker, word, searchTicks, decision );
+              double seconds = std::chrono::duration<double> ( std::chrono::steady_clock::now() - start ).count();
+
+              bool correct = known ? decision == mpus[size/2] : samuBrain.nofMPUs() > ( int ) mpus.size();
+
+              out << size << ","
+                  << t << ","
+                  << ( double ) size / t << ","
+                  << ( known ? "known" : "unknown" ) << ","
+                  << ticks << ","
+                  << searchTicks << ","
+                  << seconds << ","
+                  << correct << ","
+                  << samuBrain.getSearchWork() - work << ","
+                  << samuBrain.getExhaustiveWork() - exhaustiveWork
+                  << std::endl;
+
+              if ( !known )
+                {
+                  mpus.push_back ( samuBrain.get_foobar() );
+                  words.push_back ( word );
+                }
+
+              settle ( samuBrain, ticker, word );
+            }
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @brief End-to-end vocabulary acquisition benchmark
+ *
+ * @file SamuVocabBench.cpp
+ * @author  Norbert Bátfai <nbatfai@gmail.com>
+ * @version 0.0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright (C) 2015, 2016 Norbert Bátfai, batfai.norbert@inf.unideb.hu
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * The first n words of Rebecca Sitton's list are shown by the same ticker
+ * as in SamuVocab, but headless and without any delay between the ticks.
+ * After the agent has learnt all of them, every word is presented again
+ * and the MPU chosen by the search is compared with the MPU that has learnt
+ * the word. The Q-learning of the lookup table version has no randomness
+ * and RND_DEBUG fixes the seeds elsewhere, so two runs of the same commit
+ * are the same tick by tick.
+ *
+ * cd bench/
+ * ~/Qt/5.5/gcc_64/bin/qmake SamuVocabBench.pro
+ * make
+ * ./SamuVocabBench 20 words.csv
+ */
+
+#include "GameOfLife.h"
+#include <chrono>
+#include <fstream>
+#include <sys/resource.h>
+
+struct WordStat {
+  long learningTicks {0};
+  long searchTicks {0};
+  double seconds {0.0};
+  std::string mpu;
+  std::string recalled;
+};
+
+// the MPU names also contain the address of the MPU that changes from run to run
+std::string name ( const std::string & foobar )
+{
+  return foobar.substr ( 0, foobar.find ( ' ' ) );
+}
+
+long peak_rss_kb()
+{
+  struct rusage usage;
+  getrusage ( RUSAGE_SELF, &usage );
+  return usage.ru_maxrss;
+}
+
+// runs the ticks until the words [0, n) have been learnt or recalled
+bool present ( GameOfLife & gameOfLife, std::vector<WordStat> & stats, int n, bool recall )
+{
+  SamuBrain *samuBrain = gameOfLife.getSamuBrain();
+
+  // a word that is never learnt should not stop the benchmark forever
+  const long maxTicks {200000};
+
+  long ticks {0};
+  long age = gameOfLife.getAge();
+  auto start = std::chrono::steady_clock::now();
+
+  while ( gameOfLife.getAge() < n )
+    {
+      if ( ++ticks > maxTicks )
+        {
+          return false;
+        }
+
+      std::string foobar = samuBrain->get_foobar();
+      bool searching = samuBrain->isSearching();
+
+      gameOfLife.tick();
+
+      if ( gameOfLife.getAge() != age )
+        {
+          auto now = std::chrono::steady_clock::now();
+          WordStat & stat = stats[age];
+
+          stat.seconds += std::chrono::duration<double> ( now - start ).count();
+          if ( !recall )
+            {
+              stat.mpu = name ( foobar );
+            }
+
+          start = now;
+          age = gameOfLife.getAge();
+          if ( age >= n )
+            {
+              break;
+            }
+        }
+
+      WordStat & stat = stats[age];
+
+      if ( samuBrain->isSearching() )
+        {
+          ++stat.searchTicks;
+        }
+      else
+        {
+          ++stat.learningTicks;
+
+          if ( recall && searching && stat.recalled.empty() )
+            {
+              stat.recalled = name ( samuBrain->get_foobar() );
+            }
+        }
+    }
+
+  return true;
+}
+
+int main ( int argc, char** argv )
+{
+  GameOfLife gameOfLife ( 34, 1 );
+
+  int n = argc > 1 ? std::atoi ( argv[1] ) : 20;
+  n = std::max ( 1, std::min ( n, gameOfLife.nofWords() ) );
+
+  std::ofstream file;
+  if ( argc > 2 )
+    {
+      file.open ( argv[2] );
+    }
+  std::ostream & out = argc > 2 ? file : std::cout;
+
+  std::vector<WordStat> learnt ( n ), recalled ( n );
+
+  auto start = std::chrono::steady_clock::now();
+  bool ok = present ( gameOfLife, learnt, n, false );
+  double learningSeconds = std::chrono::duration<double> ( std::chrono::steady_clock::now() - start ).count();
+  long learningRss = peak_rss_kb();
+
+  gameOfLife.setAge ( 0 );
+  ok = ok && present ( gameOfLife, recalled, n, true );
+
+  out << "phase,index,word,learning_ticks,search_ticks,seconds,mpu" << std::endl;
+
+  int hits {0};
+  for ( int i {0}; i<n; ++i )
+    {
+      out << "learning," << i << "," << gameOfLife.word ( i )
+          << "," << learnt[i].learningTicks
+          << "," << learnt[i].searchTicks
+          << "," << learnt[i].seconds
+          << "," << learnt[i].mpu
+          << std::endl;
+    }
+  for ( int i {0}; i<n; ++i )
+    {
+      out << "recall," << i << "," << gameOfLife.word ( i )
+          << "," << recalled[i].learningTicks
+          << "," << recalled[i].searchTicks
+          << "," << recalled[i].seconds
+          << "," << recalled[i].recalled
+          << std::endl;
+
+      if ( !learnt[i].mpu.empty() && recalled[i].recalled == learnt[i].mpu )
+        {
+          ++hits;
+        }
+    }
+
+  std::cerr << "words: " << n
+            << ( ok ? "" : " (stopped, tick limit reached)" ) << std::endl
+            << "MPUs: " << gameOfLife.getSamuBrain()->nofMPUs() << std::endl
+            << "learning time: " << learningSeconds << " s" << std::endl
+            << "words per hour: " << n / learningSeconds * 3600.0 << std::endl
+            << "peak RSS after learning: " << learningRss / 1024.0 << " MB" << std::endl
+            << "GB per word: " << learningRss / 1024.0 / 1024.0 / n << std::endl
+            << "recognition accuracy: " << 100.0 * hits / n << " %" << std::endl;
+
+  return 0;
+}
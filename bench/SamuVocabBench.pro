@@ -0,0 +1,22 @@
+######################################################################
+# End-to-end vocabulary acquisition benchmark of SamuVocab
+######################################################################
+
+DEFINES += LIFEOFGAME
+DEFINES += Q_LOOKUP_TABLE
+DEFINES += RND_DEBUG
+DEFINES += QT_NO_DEBUG_OUTPUT
+
+QT += widgets core
+CONFIG += c++14 console
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
+TEMPLATE = app
+TARGET = SamuVocabBench
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../SamuBrain.h ../GameOfLife.h ../SamuQl.h ../SamuProf.h ../SamuTrace.h ../SamuLattice.h ../SamuThreads.h
+SOURCES += SamuVocabBench.cpp ../GameOfLife.cpp ../SamuBrain.cpp